@@ -0,0 +1,65 @@
+#include <NeuralNetwork.hpp>
+#include <chrono>
+#include <cstdio>
+#include <deque>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Throughput of single samples scored by many concurrent threads, each through blocking calls to
+// operator() and through submit() with a window of outstanding futures, which lets the executor
+// batch the samples of all the submitters.
+//   async-benchmark [requests per submitter]
+
+namespace {
+
+using Clock_t = std::chrono::steady_clock;
+
+template <typename Submitter_t>
+double requestsPerSecond(Size_t submitters, Size_t requests, Submitter_t submitter)
+{
+    auto const start = Clock_t::now();
+    std::vector<std::thread> threads;
+    for (Size_t t = 0; t < submitters; ++t)
+        threads.emplace_back(submitter, requests);
+    for (auto& thread : threads)
+        thread.join();
+    return submitters * requests / std::chrono::duration<double>(Clock_t::now() - start).count();
+}
+
+} // namespace
+
+int main(int argc, char** argv)
+{
+    Size_t const requests = argc > 1 ? std::stoul(argv[1]) : 2000;
+    Size_t const window = 16; // outstanding futures per submitter
+    char const* const topologies[] = { "64,256,256,10", "256,1024,1024,10" };
+
+    std::printf("%-18s %10s %14s %14s %8s\n", "topology", "submitters", "blocking req/s", "submit req/s", "speedup");
+    for (std::string const topology : topologies) {
+        DenseNN const network = DenseNN::loadModel("random:" + topology);
+        Layer::Vec_t input(network.getLayers().front().weights.rows());
+        input = blaze::map(input, [](Real_t) { return blaze::rand<Real_t>(); });
+
+        for (Size_t submitters : { 1, 4, 16, 64 }) {
+            double const blocking = requestsPerSecond(submitters, requests, [&](Size_t count) {
+                for (Size_t r = 0; r < count; ++r)
+                    network(input);
+            });
+            double const async = requestsPerSecond(submitters, requests, [&](Size_t count) {
+                std::deque<std::future<Layer::Vec_t>> pending;
+                for (Size_t r = 0; r < count; ++r) {
+                    if (pending.size() == window) {
+                        pending.front().get();
+                        pending.pop_front();
+                    }
+                    pending.push_back(network.submit(input));
+                }
+                for (auto& future : pending)
+                    future.get();
+            });
+            std::printf("%-18s %10zu %14.0f %14.0f %7.2fx\n", topology.c_str(), submitters, blocking, async, async / blocking);
+            std::fflush(stdout);
+        }
+    }
+}
@@ -0,0 +1,172 @@
+#include <DataParallel.hpp>
+#include <InferenceProtocol.hpp>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <random>
+#include <string>
+#include <vector>
+
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+// Launches N local trainer processes joined by a RingAllreduce, each one learning its share of
+// the rows of every batch, and compares them with one process learning the whole batches: every
+// rank has to end with the same bits, within rounding of the single process, in a fraction of
+// its time (up to min(N, cores) times less).
+//   data-parallel-benchmark [processes] [steps] [batch rows]
+
+namespace {
+
+using Clock_t = std::chrono::steady_clock;
+
+Size_t const Sizes[] = { 256, 1024, 1024, 16 };
+
+// the same network and batches in every process
+DenseNN makeNetwork()
+{
+    DenseNN network;
+    network.addLayer<SigmoidActivFn>(Sizes[1], Sizes[0]);
+    network.addLayer<SigmoidActivFn>(Sizes[2]);
+    network.addLayer(Sizes[3]);
+    network.setOptimizer<SGD>(0.01);
+
+    std::mt19937 generator(7);
+    std::uniform_real_distribution<Real_t> uniform(-0.05, 0.05);
+    ParameterArena parameters = network.parameters();
+    for (Size_t s = 0; s < parameters.weights.size(); ++s) {
+        for (Size_t i = 0; i < parameters.weights[s].rows(); ++i)
+            for (Size_t j = 0; j < parameters.weights[s].columns(); ++j)
+                parameters.weights[s](i, j) = uniform(generator);
+        for (Size_t j = 0; j < parameters.biases[s].size(); ++j)
+            parameters.biases[s][j] = uniform(generator);
+    }
+    network.setParameters(parameters);
+    return network;
+}
+
+std::pair<Layer::Batch_t, Layer::Batch_t> makeBatch(Size_t step, Size_t rows)
+{
+    std::mt19937 generator(1000 + step);
+    std::uniform_real_distribution<Real_t> uniform(0, 1);
+    Layer::Batch_t inputs(rows, Sizes[0]), targets(rows, Sizes[3]);
+    for (Size_t i = 0; i < rows; ++i) {
+        for (Size_t j = 0; j < inputs.columns(); ++j)
+            inputs(i, j) = uniform(generator);
+        for (Size_t j = 0; j < targets.columns(); ++j)
+            targets(i, j) = uniform(generator);
+    }
+    return { std::move(inputs), std::move(targets) };
+}
+
+struct Result {
+    DataParallelTrainer::Report report;
+    std::vector<Real_t> parameters;
+};
+
+// the rows of every batch from rank * rows / ranks on
+[[noreturn]] void trainRank(Size_t rank, Size_t ranks, std::string const& path, Size_t steps, Size_t rows, int out)
+{
+    DenseNN network = makeNetwork();
+    RingAllreduce ring(rank, ranks, path);
+    DataParallelTrainer trainer(network, ring);
+    Size_t const begin = rows * rank / ranks, end = rows * (rank + 1) / ranks;
+    for (Size_t step = 0; step < steps; ++step) {
+        auto const [inputs, targets] = makeBatch(step, rows);
+        Layer::Batch_t const shardInputs = blaze::submatrix(inputs, begin, 0, end - begin, inputs.columns());
+        Layer::Batch_t const shardTargets = blaze::submatrix(targets, begin, 0, end - begin, targets.columns());
+        trainer.learn(shardInputs, shardTargets);
+    }
+
+    ParameterArena const parameters = network.parameters();
+    DataParallelTrainer::Report const report = trainer.report();
+    bool const sent = protocol::writeAll(out, &report, sizeof(report)) &&
+                      protocol::writeAll(out, parameters.data(), parameters.size() * sizeof(Real_t));
+    std::_Exit(sent ? 0 : 1);
+}
+
+// every rank in a process of its own, started before any thread of this one
+std::vector<Result> trainRanks(Size_t ranks, Size_t steps, Size_t rows)
+{
+    std::string const path = "/tmp/backprop-ring-" + std::to_string(::getpid());
+    Size_t const size = makeNetwork().parameters().size();
+    std::vector<int> sockets;
+    std::vector<pid_t> children;
+    for (Size_t rank = 0; rank < ranks; ++rank) {
+        int fds[2];
+        if (::socketpair(AF_UNIX, SOCK_STREAM, 0, fds))
+            throw std::runtime_error("socketpair failed");
+        pid_t const pid = ::fork();
+        if (pid < 0)
+            throw std::runtime_error("fork failed");
+        if (!pid) {
+            ::close(fds[0]);
+            trainRank(rank, ranks, path, steps, rows, fds[1]);
+        }
+        ::close(fds[1]);
+        sockets.push_back(fds[0]);
+        children.push_back(pid);
+    }
+
+    std::vector<Result> results(ranks);
+    bool failed = false;
+    for (Size_t rank = 0; rank < ranks; ++rank) {
+        results[rank].parameters.resize(size);
+        failed |= !protocol::readAll(sockets[rank], &results[rank].report, sizeof(results[rank].report)) ||
+                  !protocol::readAll(sockets[rank], results[rank].parameters.data(), size * sizeof(Real_t));
+        ::close(sockets[rank]);
+    }
+    for (pid_t child : children) {
+        int status = 0;
+        ::waitpid(child, &status, 0);
+        failed |= !WIFEXITED(status) || WEXITSTATUS(status);
+    }
+    if (failed)
+        throw std::runtime_error("A trainer process failed");
+    return results;
+}
+
+} // namespace
+
+int main(int argc, char** argv)
+{
+    Size_t const processes = argc > 1 ? std::stoul(argv[1]) : 4;
+    Size_t const steps = argc > 2 ? std::stoul(argv[2]) : 20;
+    Size_t const rows = argc > 3 ? std::stoul(argv[3]) : 256;
+
+    std::vector<Result> const ranks = trainRanks(processes, steps, rows);
+
+    DenseNN network = makeNetwork();
+    auto const start = Clock_t::now();
+    for (Size_t step = 0; step < steps; ++step) {
+        auto const [inputs, targets] = makeBatch(step, rows);
+        network.learn(inputs, targets);
+    }
+    double const single = std::chrono::duration<double>(Clock_t::now() - start).count();
+    ParameterArena const parameters = network.parameters();
+
+    bool identical = true;
+    for (auto const& rank : ranks)
+        identical &= !std::memcmp(rank.parameters.data(), ranks.front().parameters.data(), parameters.size() * sizeof(Real_t));
+    double maxDiff = 0;
+    for (Size_t i = 0; i < parameters.size(); ++i)
+        maxDiff = std::max(maxDiff, double(std::abs(parameters.data()[i] - ranks.front().parameters[i])));
+    double slowest = 0, communication = 0, exposed = 0;
+    for (auto const& rank : ranks) {
+        slowest = std::max(slowest, rank.report.stepSeconds);
+        communication += rank.report.communicationSeconds / processes;
+        exposed += rank.report.exposedSeconds / processes;
+    }
+
+    std::printf("%zu processes, %zu cores, %zu steps of %zu rows, %zu parameters\n", processes,
+                Size_t(std::max(1u, std::thread::hardware_concurrency())), steps, rows, parameters.size());
+    std::printf("replicas identical: %s, max diff from one process: %g\n", identical ? "yes" : "NO", maxDiff);
+    std::printf("%-14s %10s %10s %10s %8s\n", "", "ms/step", "comm ms", "exposed ms", "speedup");
+    std::printf("%-14s %10.2f %10s %10s %7.2fx\n", "one process", single / steps * 1e3, "-", "-", 1.0);
+    std::printf("%-14s %10.2f %10.2f %10.2f %7.2fx\n", "data parallel", slowest / steps * 1e3, communication / steps * 1e3,
+                exposed / steps * 1e3, single / slowest);
+    return identical ? 0 : 1;
+}
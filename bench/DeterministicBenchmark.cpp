@@ -0,0 +1,99 @@
+#include <NeuralNetwork.hpp>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Trains copies of one network with learnParallel on 1 to 8 threads, reducing the gradients in any
+// order and in the deterministic mode: whether the weights match the single-thread run bit for bit,
+// how far they drift from it otherwise, and what the fixed reduction costs per step. Exits with 1
+// when a deterministic run does not match.
+//   deterministic-benchmark [steps] [batch rows] [block rows]
+
+namespace {
+
+using Clock_t = std::chrono::steady_clock;
+
+Size_t const Sizes[] = { 256, 1024, 1024, 16 };
+
+// every value a function of the step and its position, whatever thread fills it
+Layer::Batch_t makeBatch(std::uint64_t key, Size_t rows, Size_t columns)
+{
+    Layer::Batch_t batch(rows, columns);
+    for (Size_t i = 0; i < rows; ++i)
+        for (Size_t j = 0; j < columns; ++j)
+            batch(i, j) = counterUniform(key, i * columns + j);
+    return batch;
+}
+
+struct Run {
+    double seconds = 0;
+    std::vector<Real_t> parameters;
+};
+
+Run train(DenseNN network, Size_t threads, Size_t steps, Size_t rows)
+{
+    Run run;
+    for (Size_t step = 0; step < steps; ++step) {
+        Layer::Batch_t const inputs = makeBatch(2 * step, rows, Sizes[0]);
+        Layer::Batch_t const targets = makeBatch(2 * step + 1, rows, Sizes[3]);
+        auto const start = Clock_t::now();
+        network.learnParallel(inputs, targets, threads);
+        run.seconds += std::chrono::duration<double>(Clock_t::now() - start).count();
+    }
+    auto const& parameters = network.parameters();
+    run.parameters.assign(parameters.data(), parameters.data() + parameters.size());
+    return run;
+}
+
+} // namespace
+
+int main(int argc, char** argv)
+{
+    Size_t const steps = argc > 1 ? std::stoul(argv[1]) : 10;
+    Size_t const rows = argc > 2 ? std::stoul(argv[2]) : 256;
+    Size_t const blockRows = argc > 3 ? std::stoul(argv[3]) : 64;
+
+    DenseNN network;
+    network.addLayer<SigmoidActivFn>(Sizes[1], Sizes[0]);
+    network.addLayer<SigmoidActivFn>(Sizes[2]);
+    network.addLayer(Sizes[3]);
+    network.randomize(1).setOptimizer<Adam>(1e-3f);
+
+    std::printf("%zu steps of %zu rows, blocks of %zu rows, %u cores\n", steps, rows, blockRows,
+                std::max(1u, std::thread::hardware_concurrency()));
+    std::printf("%-14s %8s %10s %10s %14s %9s\n", "mode", "threads", "ms/step", "overhead", "same bits as 1", "max diff");
+    std::vector<double> unordered;
+    bool identical = true; // of the deterministic runs
+    for (Size_t deterministic : { Size_t(0), blockRows }) {
+        DenseNN copy = network;
+        copy.setDeterministic(deterministic);
+        Run reference;
+        for (Size_t threads : { 1, 2, 4, 8 }) {
+            Run const run = train(copy, threads, steps, rows);
+            if (threads == 1)
+                reference = run;
+            if (!deterministic)
+                unordered.push_back(run.seconds);
+            double maxDiff = 0;
+            for (Size_t i = 0; i < run.parameters.size(); ++i)
+                maxDiff = std::max(maxDiff, double(std::abs(run.parameters[i] - reference.parameters[i])));
+            bool const same = !std::memcmp(run.parameters.data(), reference.parameters.data(), run.parameters.size() * sizeof(Real_t));
+            if (deterministic)
+                identical &= same;
+
+            Size_t const index = std::min<Size_t>(unordered.size() - 1, Size_t(std::log2(threads)));
+            char overhead[16] = "-";
+            if (deterministic)
+                std::snprintf(overhead, sizeof(overhead), "%+.1f%%", (run.seconds / unordered[index] - 1) * 100);
+            std::printf("%-14s %8zu %10.2f %10s %14s %9.2g\n", deterministic ? "deterministic" : "any order", threads,
+                        run.seconds / steps * 1e3, overhead, same ? "yes" : "no", maxDiff);
+            std::fflush(stdout);
+        }
+    }
+    return identical ? 0 : 1;
+}
@@ -0,0 +1,46 @@
+#include <Gemm.hpp>
+#include <chrono>
+#include <cstdio>
+
+namespace {
+
+// GFLOP/s of the forward product of a batch of rows x inputs by inputs x outputs weights
+double gflops(Size_t rows, Size_t inputs, Size_t outputs, GemmBackend backend)
+{
+    blaze::DynamicMatrix<Real_t> A(rows, inputs), B(inputs, outputs), C;
+    A = blaze::map(A, [](Real_t) { return blaze::rand<Real_t>(); });
+    B = blaze::map(B, [](Real_t) { return blaze::rand<Real_t>(); });
+
+    using Clock_t = std::chrono::steady_clock;
+    gemm(A, false, B, false, C, 0, backend);
+    Size_t repeats = 0;
+    auto const start = Clock_t::now();
+    double seconds = 0;
+    while (seconds < 0.2) {
+        gemm(A, false, B, false, C, 0, backend);
+        ++repeats;
+        seconds = std::chrono::duration<double>(Clock_t::now() - start).count();
+    }
+    return 2e-9 * rows * inputs * outputs * repeats / seconds;
+}
+
+} // namespace
+
+int main()
+{
+    Size_t const shapes[][3] = { { 256, 2, 16 }, { 256, 16, 16 }, { 256, 16, 1 }, { 32, 256, 256 },
+                                 { 256, 256, 256 }, { 64, 1024, 1024 }, { 256, 1024, 1024 }, { 512, 2048, 2048 } };
+
+    std::printf("cutoff: %zu multiply-adds, cblas %s\n", Size_t(BACKPROP_CBLAS_CUTOFF), cblasAvailable() ? "enabled" : "disabled");
+    std::printf("%6s %6s %7s %12s %12s  %s\n", "rows", "inputs", "outputs", "blaze GF/s", "cblas GF/s", "faster");
+    for (auto const& [rows, inputs, outputs] : shapes) {
+        double const blazeRate = gflops(rows, inputs, outputs, GemmBackend::Blaze);
+        if (cblasAvailable()) {
+            double const cblasRate = gflops(rows, inputs, outputs, GemmBackend::Cblas);
+            std::printf("%6zu %6zu %7zu %12.2f %12.2f  %s\n", rows, inputs, outputs, blazeRate, cblasRate,
+                        blazeRate < cblasRate ? "cblas" : "blaze");
+        }
+        else
+            std::printf("%6zu %6zu %7zu %12.2f %12s  -\n", rows, inputs, outputs, blazeRate, "-");
+    }
+}
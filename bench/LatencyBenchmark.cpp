@@ -0,0 +1,53 @@
+#include <LatencyInference.hpp>
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+namespace {
+
+// p50 and p99 of the latency in microseconds of single samples through eval(input, output), over
+// up to 20000 samples or about a second
+template <typename Eval_t>
+std::pair<double, double> latency(Eval_t eval, Size_t inputSize)
+{
+    using Clock_t = std::chrono::steady_clock;
+    Layer::Vec_t input(inputSize), output;
+    input = blaze::map(input, [](Real_t) { return blaze::rand<Real_t>(); });
+
+    auto const warmup = Clock_t::now();
+    for (Size_t i = 0; i < 100; ++i)
+        eval(input, output);
+    double const seconds = std::chrono::duration<double>(Clock_t::now() - warmup).count() / 100;
+    Size_t const samples = std::clamp(Size_t(1 / seconds), Size_t(200), Size_t(20000));
+
+    std::vector<double> micros(samples);
+    for (auto& m : micros) {
+        auto const start = Clock_t::now();
+        eval(input, output);
+        m = std::chrono::duration<double, std::micro>(Clock_t::now() - start).count();
+    }
+    std::sort(micros.begin(), micros.end());
+    return { micros[samples / 2], micros[samples * 99 / 100] };
+}
+
+} // namespace
+
+int main()
+{
+    char const* const topologies[] = { "2,16,16,2", "64,256,256,10", "256,1024,1024,10", "1024,4096,4096,10" };
+
+    std::printf("panel width: %zu floats\n", PackedGemv::panelWidth());
+    std::printf("%-22s %12s %12s %12s %12s\n", "topology", "eval p50 us", "eval p99 us", "packed p50", "packed p99");
+    for (std::string const topology : topologies) {
+        DenseNN const network = DenseNN::loadModel("random:" + topology);
+        LatencyInference packed(network);
+        Size_t const inputSize = network.getLayers().front().weights.rows();
+
+        auto const eval = latency([&](Layer::Vec_t const& in, Layer::Vec_t& out) { out = network(in); }, inputSize);
+        auto const fast = latency([&](Layer::Vec_t const& in, Layer::Vec_t& out) { packed.eval(in, out); }, inputSize);
+
+        std::printf("%-22s %12.2f %12.2f %12.2f %12.2f\n", topology.c_str(), eval.first, eval.second, fast.first, fast.second);
+    }
+}
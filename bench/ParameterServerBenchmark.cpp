@@ -0,0 +1,123 @@
+#include <ParameterServer.hpp>
+#include <cmath>
+#include <cstdio>
+#include <random>
+#include <string>
+#include <vector>
+
+#include <sys/wait.h>
+#include <unistd.h>
+
+// Trains one network through a ParameterServer from N worker processes, each learning batches of
+// its own, with every gradient compression: the bytes on the wire per push, the loss reached on
+// held-out samples of the same teacher network, and how long the staleness bound held the pulls.
+//   parameter-server-benchmark [workers] [steps per worker] [batch rows] [staleness]
+
+namespace {
+
+using Clock_t = std::chrono::steady_clock;
+
+Size_t const Inputs = 32;
+
+// a DenseNN::loadModel "random:" topology with normal weights of the given seed
+DenseNN makeNetwork(unsigned seed, std::string const& model)
+{
+    DenseNN network = DenseNN::loadModel(model);
+
+    std::mt19937 generator(seed);
+    std::normal_distribution<Real_t> normal(0, 1);
+    ParameterArena parameters = network.parameters();
+    for (Size_t s = 0; s < parameters.weights.size(); ++s)
+        for (Size_t i = 0; i < parameters.weights[s].rows(); ++i)
+            for (Size_t j = 0; j < parameters.weights[s].columns(); ++j)
+                parameters.weights[s](i, j) = normal(generator) / std::sqrt(Real_t(parameters.weights[s].rows()));
+    network.setParameters(parameters);
+    return network;
+}
+
+DenseNN makeStudent() { return makeNetwork(1, "random:32,256,256,4").setOptimizer<SGD>(0.05f); }
+
+// targets of a fixed random network with a narrower hidden layer
+Dataset makeBatch(unsigned seed, Size_t rows)
+{
+    static DenseNN const teacher = makeNetwork(2, "random:32,16,4");
+    std::mt19937 generator(seed);
+    std::uniform_real_distribution<Real_t> uniform(-1, 1);
+    Dataset batch{ Layer::Batch_t(rows, Inputs), {} };
+    for (Size_t i = 0; i < rows; ++i)
+        for (Size_t j = 0; j < Inputs; ++j)
+            batch.inputs(i, j) = uniform(generator);
+    batch.targets = teacher(batch.inputs);
+    return batch;
+}
+
+[[noreturn]] void work(std::string const& path, GradientCompression compression, Size_t worker, Size_t steps, Size_t rows)
+{
+    try {
+        DenseNN network = makeStudent();
+        ParameterClient client(path, compression);
+        DenseNN::Gradient gradient = network.makeGradient();
+        for (Size_t step = 0; step < steps; ++step) {
+            Dataset const batch = makeBatch(unsigned(1000 + worker * steps + step), rows);
+            client.pull(network);
+            network.accumulateGradient(batch.inputs, batch.targets, gradient);
+            client.push(gradient);
+        }
+        std::_Exit(0);
+    }
+    catch (std::exception const& e) {
+        std::fprintf(stderr, "worker %zu: %s\n", worker, e.what());
+        std::_Exit(1);
+    }
+}
+
+} // namespace
+
+int main(int argc, char** argv)
+{
+    Size_t const workers = argc > 1 ? std::stoul(argv[1]) : 4;
+    Size_t const steps = argc > 2 ? std::stoul(argv[2]) : 200;
+    Size_t const rows = argc > 3 ? std::stoul(argv[3]) : 32;
+    ParameterServer::Options options;
+    options.workers = workers;
+    options.staleness = argc > 4 ? std::stoul(argv[4]) : 2;
+
+    Dataset const heldOut = makeBatch(1, 1024);
+    std::printf("%zu workers, %zu steps of %zu rows each, staleness %zu, initial loss %.5f\n", workers, steps, rows,
+                options.staleness, makeStudent().evaluate(heldOut, 1).loss);
+    std::printf("%-12s %12s %8s %10s %10s %12s %10s\n", "compression", "bytes/push", "ratio", "loss", "seconds",
+                "held seconds", "staleness");
+
+    GradientCompression const compressions[] = { { GradientCompression::None }, { GradientCompression::Int8 },
+                                                 { GradientCompression::TopK, 0.01f } };
+    char const* names[] = { "none", "int8", "top 1%" };
+    for (Size_t c = 0; c < std::size(compressions); ++c) {
+        // the workers fork before the server starts any thread
+        std::string const path = "/tmp/backprop-ps-" + std::to_string(::getpid());
+        std::vector<pid_t> children;
+        for (Size_t worker = 0; worker < workers; ++worker)
+            if (pid_t const pid = ::fork(); !pid)
+                work(path, compressions[c], worker, steps, rows);
+            else
+                children.push_back(pid);
+
+        auto const start = Clock_t::now();
+        ParameterServer server(makeStudent(), path, options);
+        server.run();
+        double const seconds = std::chrono::duration<double>(Clock_t::now() - start).count();
+        bool failed = false;
+        for (pid_t child : children) {
+            int status = 0;
+            ::waitpid(child, &status, 0);
+            failed |= !WIFEXITED(status) || WEXITSTATUS(status);
+        }
+        if (failed)
+            return 1;
+
+        auto const stats = server.stats();
+        std::printf("%-12s %12.0f %7.1fx %10.5f %10.2f %12.2f %10zu\n", names[c], double(stats.gradientBytes) / stats.pushes,
+                    double(stats.denseBytes) / stats.gradientBytes, server.model().evaluate(heldOut, 1).loss, seconds,
+                    stats.heldSeconds, stats.maxStaleness);
+        std::fflush(stdout);
+    }
+}
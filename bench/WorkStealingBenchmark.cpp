@@ -0,0 +1,80 @@
+#include <NeuralNetwork.hpp>
+#include <WorkStealingPool.hpp>
+#include <blaze/util/ThreadPool.h>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <cstdlib>
+#include <mutex>
+#include <thread>
+
+// Microseconds per vector-matrix product of a layer-sized weight matrix split into tasks of 64
+// columns, on blaze::ThreadPool and on WorkStealingPool, against the serial product: the small
+// tasks of NN layers, where waking workers and locking the queue cost as much as the work.
+//   work-stealing-benchmark [threads]
+
+using BlazePool_t = blaze::ThreadPool<std::thread, std::mutex, std::unique_lock<std::mutex>, std::condition_variable>;
+
+namespace {
+
+constexpr Size_t TaskColumns = 64;
+
+void product(Layer::Vec_t const& input, blaze::DynamicMatrix<Real_t> const& weights, Layer::Vec_t& output, Size_t begin)
+{
+    Size_t const width = std::min(TaskColumns, weights.columns() - begin);
+    blaze::subvector(output, begin, width) = blaze::serial(input * blaze::submatrix(weights, 0, begin, weights.rows(), width));
+}
+
+// the best mean of a few rounds of about 20ms each
+template <typename Run_t>
+double micros(Run_t run)
+{
+    using Clock_t = std::chrono::steady_clock;
+    auto const warmup = Clock_t::now();
+    for (Size_t i = 0; i < 100; ++i)
+        run();
+    double const once = std::chrono::duration<double>(Clock_t::now() - warmup).count() / 100;
+    Size_t const repeats = Size_t(0.02 / once) + 1;
+
+    double best = once;
+    for (Size_t round = 0; round < 5; ++round) {
+        auto const start = Clock_t::now();
+        for (Size_t r = 0; r < repeats; ++r)
+            run();
+        best = std::min(best, std::chrono::duration<double>(Clock_t::now() - start).count() / repeats);
+    }
+    return best * 1e6;
+}
+
+template <typename Pool_t>
+double pooled(Pool_t& pool, Layer::Vec_t const& input, blaze::DynamicMatrix<Real_t> const& weights, Layer::Vec_t& output)
+{
+    return micros([&] {
+        for (Size_t begin = 0; begin < weights.columns(); begin += TaskColumns)
+            pool.schedule([&, begin] { product(input, weights, output, begin); });
+        pool.wait();
+    });
+}
+
+} // namespace
+
+int main(int argc, char** argv)
+{
+    Size_t const threads = argc > 1 ? std::stoul(argv[1]) : std::max(2u, std::thread::hardware_concurrency());
+    BlazePool_t blazePool(threads);
+    WorkStealingPool stealingPool(threads);
+
+    std::printf("%zu threads, tasks of %zu columns\n", threads, TaskColumns);
+    std::printf("%6s %6s %6s %12s %12s %12s\n", "rows", "cols", "tasks", "serial us", "blaze us", "stealing us");
+    for (Size_t size : { 128, 256, 512, 1024, 2048 }) {
+        blaze::DynamicMatrix<Real_t> weights(size, size);
+        weights = blaze::map(weights, [](Real_t) { return blaze::rand<Real_t>() - 0.5f; });
+        Layer::Vec_t input(size), output(size);
+        input = blaze::map(input, [](Real_t) { return blaze::rand<Real_t>(); });
+
+        double const serial = micros([&] { output = blaze::serial(input * weights); });
+        double const blaze = pooled(blazePool, input, weights, output);
+        double const stealing = pooled(stealingPool, input, weights, output);
+        std::printf("%6zu %6zu %6zu %12.2f %12.2f %12.2f\n", size, size, (size + TaskColumns - 1) / TaskColumns, serial, blaze, stealing);
+    }
+}
@@ -0,0 +1,94 @@
+#pragma once
+
+#include <ModelHandle.hpp>
+#include <NeuralNetwork.hpp>
+#include <chrono>
+#include <condition_variable>
+#include <exception>
+#include <functional>
+#include <future>
+#include <mutex>
+#include <optional>
+#include <set>
+#include <stdexcept>
+#include <thread>
+#include <tuple>
+
+
+struct DeadlineMissed : std::runtime_error {
+    DeadlineMissed() : std::runtime_error("The deadline of the request passed before it was run") {}
+};
+
+
+// Coalesces single-sample requests into batches of up to maxRows rows and runs them through batched
+// inference of a copy of a DenseNN on a pool of workers. swapModel replaces the DenseNN while
+// requests are served: running batches finish on the old one, the next ones take the new one. A
+// batch leaves when maxRows requests wait, when the oldest one waited maxDelay, or when waiting
+// longer could miss the deadline of the most urgent one. Requests of higher priority go first, ties
+// run earliest deadline first; requests whose deadline has passed when they are taken fail without
+// being run. If the network throws, only the requests of that batch fail; the workers go on.
+class BatchScheduler {
+public:
+    using Clock_t = std::chrono::steady_clock;
+    // nullopt: the request failed with error, a DeadlineMissed if its deadline passed before it ran
+    using Callback_t = std::function<void(std::optional<Layer::Vec_t> output, std::exception_ptr error)>;
+
+    struct Options {
+        Size_t maxRows = 32;
+        std::chrono::microseconds maxDelay{ 200 };
+        Size_t workers = 0; // 0: one per core
+    };
+
+    struct Stats {
+        Size_t requests = 0; // run or failed
+        Size_t batches = 0;
+        Size_t missedDeadlines = 0;
+        Size_t failures = 0; // of requests whose batch threw
+    };
+
+    explicit BatchScheduler(DenseNN network, Options options);
+    explicit BatchScheduler(DenseNN network) : BatchScheduler(std::move(network), Options()) {}
+    ~BatchScheduler(); // runs the queued requests first
+
+    // done is called on a worker thread, what it throws is dropped
+    void submit(Layer::Vec_t input, Callback_t done, Clock_t::time_point deadline = Clock_t::time_point::max(), int priority = 0);
+    std::future<Layer::Vec_t> submit(Layer::Vec_t input, Clock_t::time_point deadline = Clock_t::time_point::max(), int priority = 0);
+
+    // the new network needs the input size of the old one, requests of that size may be queued
+    void swapModel(DenseNN network);
+
+    Stats stats() const;
+    Size_t inputSize() const { return inputCount; }
+
+private:
+    struct Request {
+        int priority;
+        Clock_t::time_point deadline;
+        Size_t sequence;
+        Clock_t::time_point arrival;
+        Layer::Vec_t input;
+        Callback_t done;
+
+        bool operator<(Request const& other) const
+        {
+            return std::tie(other.priority, deadline, sequence) < std::tie(priority, other.deadline, other.sequence);
+        }
+    };
+
+    void run();
+    static void fail(Request const& request, std::exception_ptr error);
+    bool batchReady(Clock_t::time_point now, Clock_t::time_point& wakeUp) const;
+
+    Size_t const inputCount;
+    ModelHandle model;
+    Options const options;
+
+    mutable std::mutex mutex;
+    std::condition_variable queued;
+    std::multiset<Request> requests;              // in the order they are taken
+    std::multiset<Clock_t::time_point> arrivals; // of the queued requests
+    Size_t sequence = 0;
+    Stats counters;
+    bool stopping = false;
+    std::vector<std::thread> workers;
+};
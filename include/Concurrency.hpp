@@ -0,0 +1,134 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+
+// Unbounded FIFO between threads, pop blocks until a value is available.
+template <typename T>
+class Channel {
+public:
+    void push(T value)
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            values.push_back(std::move(value));
+        }
+        ready.notify_one();
+    }
+
+    T pop()
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        ready.wait(lock, [this] { return !values.empty(); });
+        T value = std::move(values.front());
+        values.pop_front();
+        return value;
+    }
+
+private:
+    std::mutex mutex;
+    std::condition_variable ready;
+    std::deque<T> values;
+};
+
+
+// Chase-Lev work-stealing deque of pointers (in the C11 formulation of Le et al.): its owner
+// pushes and pops at the bottom without locks, any thread steals from the top with one CAS.
+// The ring doubles when full; outgrown rings stay alive until the deque is destroyed, as thieves
+// may still read from them.
+template <typename T>
+class ChaseLevDeque {
+public:
+    ChaseLevDeque() : ring(new Ring(64)) { rings.emplace_back(ring.load()); }
+
+    // owner only
+    void push(T* value)
+    {
+        std::int64_t const b = bottom.load(std::memory_order_relaxed);
+        std::int64_t const t = top.load(std::memory_order_acquire);
+        Ring* r = ring.load(std::memory_order_relaxed);
+        if (b - t > std::int64_t(r->capacity) - 1)
+            r = grow(r, t, b);
+        r->at(b).store(value, std::memory_order_relaxed);
+        bottom.store(b + 1, std::memory_order_release);
+    }
+
+    // owner only, nullptr when empty
+    T* pop()
+    {
+        std::int64_t const b = bottom.load(std::memory_order_relaxed) - 1;
+        Ring* const r = ring.load(std::memory_order_relaxed);
+        bottom.store(b, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        std::int64_t t = top.load(std::memory_order_relaxed);
+        if (t > b) {
+            bottom.store(b + 1, std::memory_order_relaxed);
+            return nullptr;
+        }
+        T* value = r->at(b).load(std::memory_order_relaxed);
+        if (t == b) {
+            // the last value, a thief may be taking it
+            if (!top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed))
+                value = nullptr;
+            bottom.store(b + 1, std::memory_order_relaxed);
+        }
+        return value;
+    }
+
+    // any thread, nullptr when empty or when another thread took the value first
+    T* steal()
+    {
+        std::int64_t t = top.load(std::memory_order_acquire);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        std::int64_t const b = bottom.load(std::memory_order_acquire);
+        if (t >= b)
+            return nullptr;
+        T* const value = ring.load(std::memory_order_acquire)->at(t).load(std::memory_order_relaxed);
+        if (!top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed))
+            return nullptr;
+        return value;
+    }
+
+    bool empty() const { return top.load(std::memory_order_acquire) >= bottom.load(std::memory_order_acquire); }
+
+private:
+    struct Ring {
+        explicit Ring(std::size_t capacity) : capacity(capacity), slots(new std::atomic<T*>[capacity]) {}
+        std::atomic<T*>& at(std::int64_t i) { return slots[std::size_t(i) & (capacity - 1)]; }
+
+        std::size_t const capacity; // a power of two
+        std::unique_ptr<std::atomic<T*>[]> slots;
+    };
+
+    Ring* grow(Ring* old, std::int64_t t, std::int64_t b)
+    {
+        Ring* const bigger = rings.emplace_back(new Ring(2 * old->capacity)).get();
+        for (std::int64_t i = t; i < b; ++i)
+            bigger->at(i).store(old->at(i).load(std::memory_order_relaxed), std::memory_order_relaxed);
+        ring.store(bigger, std::memory_order_release);
+        return bigger;
+    }
+
+    // top and bottom on lines of their own, thieves hammer top while the owner works at bottom
+    alignas(64) std::atomic<std::int64_t> top{ 0 };
+    alignas(64) std::atomic<std::int64_t> bottom{ 0 };
+    std::atomic<Ring*> ring;
+    std::vector<std::unique_ptr<Ring>> rings; // owned by the owner
+};
+
+
+// pins the calling thread to the cpu (modulo the cpu count), false where unsupported
+bool pinCurrentThread(std::size_t cpu);
+
+// lets the calling thread run on any of the cpus, false where unsupported
+bool pinCurrentThread(std::vector<std::size_t> const& cpus);
+
+// the cpus of every NUMA node, a single node holding every cpu where the topology is unknown
+std::vector<std::vector<std::size_t>> numaNodes();
@@ -0,0 +1,85 @@
+#pragma once
+
+#include <Concurrency.hpp>
+#include <NeuralNetwork.hpp>
+#include <chrono>
+#include <exception>
+#include <optional>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+
+// Sums a buffer over the processes of a ring, each one connected to the next by a Unix socket,
+// the stand-in of a cluster's network on one host. The buffer is split into one chunk per
+// process: a reduce-scatter leaves every process with the total of one chunk, then an
+// all-gather passes the totals around, so every process ends with the same bits while each one
+// sends and receives 2 (ranks - 1) / ranks of the buffer. Every step sends a chunk while the
+// previous one arrives, in segments of SegmentBytes that are added up as they come in.
+class RingAllreduce {
+public:
+    static constexpr Size_t SegmentBytes = 64 * 1024;
+
+    // rank r listens on path.r and connects to rank (r + 1) % ranks, waiting up to timeout for it
+    // and for rank r - 1 to connect
+    RingAllreduce(Size_t rank, Size_t ranks, std::string const& path,
+                  std::chrono::milliseconds timeout = std::chrono::seconds(10));
+    ~RingAllreduce();
+    RingAllreduce(RingAllreduce const&) = delete;
+    RingAllreduce& operator=(RingAllreduce const&) = delete;
+
+    // throw std::runtime_error once a peer is gone
+    void allreduce(Real_t* data, Size_t size); // in place
+    void broadcast(Real_t* data, Size_t size); // of rank 0
+
+    Size_t rank() const { return self; }
+    Size_t ranks() const { return count; }
+
+private:
+    template <typename Arrived_t>
+    void exchange(Real_t const* send, Size_t sendCount, Real_t* receive, Size_t receiveCount, Arrived_t arrived);
+
+    Size_t const self;
+    Size_t const count;
+    int next = -1;     // socket to rank + 1
+    int previous = -1; // socket from rank - 1
+    std::vector<Real_t> incoming;
+};
+
+
+// Data-parallel training of the replicas of a DenseNN held by the processes of a ring. Every
+// process runs the backward pass over its own rows of the batch. The gradients of the layers it
+// has finished, grouped into buckets of at least bucketFloats values of contiguous layers, are
+// summed over the ring on a communication thread while the pass goes on below them. Every process
+// then applies the same summed gradient, so the replicas stay identical.
+class DataParallelTrainer {
+public:
+    struct Report {
+        double stepSeconds = 0;          // of the learn calls
+        double communicationSeconds = 0; // of the allreduces
+        double exposedSeconds = 0;       // waiting for the allreduces after the backward pass
+    };
+
+    // the parameters of rank 0 are copied to every replica first
+    DataParallelTrainer(DenseNN& network, RingAllreduce& ring, Size_t bucketFloats = 1 << 18);
+    ~DataParallelTrainer();
+
+    // one optimizer step along the gradient averaged over the rows of every process, throws the
+    // std::runtime_error of the ring once a peer is gone
+    void learn(Layer::Batch_t const& inputs, Layer::Batch_t const& targets);
+
+    Report report() const { return totals; } // over every learn call so far
+
+private:
+    void run();
+
+    DenseNN& network;
+    RingAllreduce& ring;
+    Size_t const bucketFloats;
+    DenseNN::Gradient gradient;
+    Channel<std::optional<std::pair<Size_t, Size_t>>> buckets; // ranges of the flat gradient, nullopt stops
+    Channel<std::pair<double, std::exception_ptr>> reduced;    // seconds of every summed bucket, the error of the ring
+    Report totals;
+    std::thread thread;
+};
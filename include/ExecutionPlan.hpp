@@ -0,0 +1,47 @@
+#pragma once
+
+#include <NeuralNetwork.hpp>
+#include <map>
+#include <optional>
+#include <string>
+#include <tuple>
+
+
+// How one layer evaluates a batch of rows
+struct ExecutionStrategy {
+    enum Kind {
+        RowWise,  // one vector-matrix product per row, on the caller
+        Gemm,     // one matrix-matrix product for the whole batch on the caller, see gemm()
+        Threaded  // the batch product split by rows (or by columns for fewer rows) across threads
+    };
+
+    Kind kind = Gemm;
+    Size_t threads = 1;
+};
+
+
+// The fastest strategy of every layer shape (inputs x outputs) at the batch sizes it was tuned for.
+// Plans are keyed by shapes, not by layer indices, so networks of the same shapes can share one.
+class ExecutionPlan {
+public:
+    void set(Size_t inputs, Size_t outputs, Size_t batchSize, ExecutionStrategy strategy);
+
+    // the strategy of the largest tuned batch size not above batchSize (the smallest one if there
+    // is none), Gemm for untuned shapes
+    ExecutionStrategy find(Size_t inputs, Size_t outputs, Size_t batchSize) const;
+    bool contains(Size_t inputs, Size_t outputs, Size_t batchSize) const;
+
+    // Text file, one "inputs outputs batchSize strategy threads" line per entry after a header with
+    // the number of hardware threads. load returns nothing for a missing or unreadable file, or for
+    // a plan tuned on a machine with a different number of hardware threads.
+    void save(std::string const& path) const;
+    static std::optional<ExecutionPlan> load(std::string const& path);
+
+    // times every strategy for the shape at batchSize, with 2, 4, ... up to maxThreads threads
+    static ExecutionStrategy measure(Size_t inputs, Size_t outputs, Size_t batchSize, Size_t maxThreads);
+
+    static void run(Layer const& layer, ExecutionStrategy strategy, Layer::Batch_t const& inputs, Layer::Batch_t& outputs);
+
+private:
+    std::map<std::tuple<Size_t, Size_t, Size_t>, ExecutionStrategy> entries;
+};
@@ -0,0 +1,63 @@
+#pragma once
+
+#include <NeuralNetwork.hpp>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+
+// Products of dense batches and layer weights with at least this many multiply-adds go to the
+// CBLAS sgemm when the project is built with the blas option, the smaller ones stay with Blaze.
+#ifndef BACKPROP_CBLAS_CUTOFF
+#define BACKPROP_CBLAS_CUTOFF 262144UL // 64 x 64 x 64
+#endif
+
+enum class GemmBackend {
+    Auto,  // Cblas from BACKPROP_CBLAS_CUTOFF multiply-adds on, if available, Blaze otherwise
+    Blaze,
+    Cblas  // throws when the project was built without the blas option
+};
+
+bool cblasAvailable();
+
+// rows of a batch viewed in place, as evaluate() walks through a dataset
+using BatchRows_t = std::decay_t<decltype(blaze::submatrix(std::declval<Layer::Batch_t const&>(), 0, 0, 0, 0))>;
+
+// C = beta * C + op(A) * op(B), where op transposes its matrix when the flag is set. A zero beta
+// ignores the elements of C and resizes it, a Layer::Weights_t has to be of the size of the product.
+// Every matrix is a blaze::DynamicMatrix<Real_t> or a Layer::Weights_t, A may also be a BatchRows_t
+// multiplied by weights, which is read through its data and spacing without a copy.
+template <typename A_t, typename B_t, typename C_t>
+void gemm(A_t const& A, bool transposeA, B_t const& B, bool transposeB, C_t& C, Real_t beta = 0,
+          GemmBackend backend = GemmBackend::Auto);
+
+
+// out[i] = dot(row i of A, x) * scale(z[i]) for every row of A, where x holds A.columns() values
+// and no scale leaves the dots as they are. For the weights of a layer and its delta, with the
+// derivative of the activation of the layer below, this is the delta of that layer in one pass
+// over the weights, four rows at a time.
+using RowScaleFn_t = Real_t (*)(Real_t);
+void rowDots(Layer::Weights_t const& A, Real_t const* x, Real_t* out, RowScaleFn_t scale = nullptr, Real_t const* z = nullptr);
+
+
+// Weights and biases of a layer repacked once for batch-1 products: panels of panelWidth() columns,
+// each one stored row after row, so multiplying streams the weights with unit stride, four SIMD
+// registers of columns at a time, and prefetches the rows ahead.
+class PackedGemv {
+public:
+    PackedGemv(Layer::Weights_t const& weights, Layer::Biases_t const& biases);
+
+    // output = input * weights + biases, output needs room for paddedColumns() elements
+    void multiply(Real_t const* input, Real_t* output) const;
+
+    Size_t rows() const { return k; }
+    Size_t columns() const { return n; }
+    Size_t paddedColumns() const;
+    static Size_t panelWidth(); // of the processor's kernel
+
+private:
+    Size_t k;
+    Size_t n;
+    std::vector<CacheLine_t> panels;
+    std::vector<CacheLine_t> biases; // zero past the last column
+};
@@ -0,0 +1,49 @@
+#pragma once
+
+#include <NeuralNetwork.hpp>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+
+// Frames of the local inference server, in native byte order since both ends share the host.
+// Every request is one sample, answered by one response with the same id; the responses of a
+// connection may come in any order.
+namespace protocol {
+
+constexpr std::uint32_t RequestMagic = 0x42505251;  // "BPRQ"
+constexpr std::uint32_t ResponseMagic = 0x42505253; // "BPRS"
+
+struct RequestHeader {
+    std::uint32_t magic = RequestMagic;
+    std::uint32_t id = 0;
+    std::uint32_t size = 0;         // floats following the header
+    std::int32_t priority = 0;      // higher first
+    std::uint64_t budgetMicros = 0; // deadline relative to the arrival, 0 for none
+};
+
+enum Status : std::uint32_t { Ok = 0, DeadlineMissed = 1, BadRequest = 2, Failed = 3 }; // Failed: the model threw
+
+struct ResponseHeader {
+    std::uint32_t magic = ResponseMagic;
+    std::uint32_t id = 0;
+    std::uint32_t status = Ok;
+    std::uint32_t size = 0; // floats following the header
+};
+
+// every byte of a socket, false once the peer closed the connection or on an error; writeAll does
+// not raise SIGPIPE
+bool readAll(int fd, void* data, Size_t bytes);
+bool writeAll(int fd, void const* data, Size_t bytes);
+
+// false once the peer closed the connection or sent a malformed frame
+bool readRequest(int fd, RequestHeader& header, std::vector<Real_t>& values);
+bool readResponse(int fd, ResponseHeader& header, std::vector<Real_t>& values);
+bool writeRequest(int fd, RequestHeader const& header, Real_t const* values);
+bool writeResponse(int fd, ResponseHeader const& header, Real_t const* values);
+
+// throw std::runtime_error on failure
+int listenUnix(std::string const& path); // replaces a stale socket file
+int connectUnix(std::string const& path);
+
+} // namespace protocol
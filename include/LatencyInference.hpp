@@ -0,0 +1,25 @@
+#pragma once
+
+#include <Gemm.hpp>
+#include <NeuralNetwork.hpp>
+
+
+// Single-sample inference over a copy of a DenseNN whose layers are repacked once into PackedGemv
+// panels. eval allocates nothing once its output has the right size, so the latency of a request
+// is only the streaming of the weights.
+class LatencyInference {
+public:
+    explicit LatencyInference(DenseNN const& network);
+
+    Layer::Vec_t operator()(Layer::Vec_t const& input);
+    void eval(Layer::Vec_t const& input, Layer::Vec_t& output);
+
+private:
+    struct Stage {
+        PackedGemv weights;
+        Layer::ActivFn_t activFn;
+    };
+
+    std::vector<Stage> stages;
+    std::vector<Real_t> buffers[2]; // padded outputs of the stages, alternately
+};
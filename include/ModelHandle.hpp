@@ -0,0 +1,72 @@
+#pragma once
+
+#include <NeuralNetwork.hpp>
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+
+// A DenseNN that serving threads read while another thread swaps in a retrained one. Readers pin
+// the current model with read(): an increment of a per-thread reader counter and a load of an
+// atomic pointer, no locks and no waiting. swap() publishes the new model at once, then waits for
+// the readers that may still use the old one (a grace period, as in sleepable RCU) and destroys it
+// on the swapping thread, so in-flight inferences finish on the old model and no reader ever
+// pays for the swap.
+class ModelHandle {
+public:
+    // keeps the model it was taken from alive until it is destroyed
+    class Reader {
+    public:
+        Reader(Reader&& other) : counter(std::exchange(other.counter, nullptr)), network(other.network) {}
+        Reader(Reader const&) = delete;
+        Reader& operator=(Reader const&) = delete;
+        ~Reader()
+        {
+            if (counter)
+                counter->fetch_sub(1, std::memory_order_release);
+        }
+
+        DenseNN const& operator*() const { return *network; }
+        DenseNN const* operator->() const { return network; }
+
+    private:
+        friend class ModelHandle;
+        Reader(std::atomic<Size_t>* counter, DenseNN const* network) : counter(counter), network(network) {}
+
+        std::atomic<Size_t>* counter;
+        DenseNN const* network;
+    };
+
+    explicit ModelHandle(DenseNN network);
+    ~ModelHandle(); // no reader may outlive the handle
+
+    Reader read() const
+    {
+        Stripe& stripe = stripes[stripeIndex() % stripes.size()];
+        // a reader that counts itself in a parity a swap has already drained sees the new model
+        std::atomic<Size_t>& counter = stripe.readers[parity.load(std::memory_order_seq_cst)];
+        counter.fetch_add(1, std::memory_order_seq_cst);
+        return Reader(&counter, current.load(std::memory_order_seq_cst));
+    }
+
+    // returns once no reader uses the old model anymore, swaps are serialized
+    void swap(DenseNN network);
+    Size_t version() const { return swaps.load(std::memory_order_relaxed); }
+
+private:
+    // counters of the readers that entered while the parity was 0 or 1, one cache line per stripe
+    // of threads so that readers on different cores do not share counters
+    struct alignas(64) Stripe {
+        std::atomic<Size_t> readers[2] = { { 0 }, { 0 } };
+    };
+
+    static Size_t stripeIndex();
+    void waitForReaders(Size_t parity) const;
+
+    std::atomic<DenseNN const*> current;
+    std::atomic<Size_t> parity{ 0 };
+    std::atomic<Size_t> swaps{ 0 };
+    mutable std::vector<Stripe> stripes;
+    std::mutex swapping;
+};
@@ -0,0 +1,73 @@
+#pragma once
+
+#include <NeuralNetwork.hpp>
+#include <condition_variable>
+#include <mutex>
+#include <optional>
+#include <thread>
+
+
+// A layer split by output columns across pinned threads. Every thread copies its column slice of
+// the weights and biases itself, so the slice is first-touched in that thread's NUMA node, and
+// keeps it for its whole lifetime; only the input and the output slices travel between threads.
+class ShardedLayer {
+public:
+    ShardedLayer(Layer const& layer, Size_t threads, Size_t firstCpu = 0);
+    ~ShardedLayer();
+
+    // throw std::logic_error for inputs of another size than the layer's
+    void eval(Layer::Vec_t const& input, Layer::Vec_t& output);
+    void eval(Layer::Batch_t const& inputs, Layer::Batch_t& outputs);
+
+    Size_t inputSize() const { return rows; }
+    Size_t outputSize() const { return columns; }
+
+private:
+    struct Shard {
+        Size_t begin;
+        Size_t end;
+        blaze::DynamicMatrix<Real_t> weights;
+        Layer::Vec_t biases;
+        std::thread thread;
+    };
+
+    void run(Size_t index, Size_t cpu);
+    void dispatch(); // runs the job on every shard and waits for all of them
+
+    Layer const* source; // only during construction
+    Size_t rows;
+    Size_t columns;
+    Layer::ActivFn_t activFn;
+    std::vector<Shard> shards;
+
+    std::mutex mutex;
+    std::condition_variable started;
+    std::condition_variable finished;
+    Size_t generation = 0;
+    Size_t completed = 0;
+    bool stopping = false;
+
+    Layer::Vec_t const* vecInput = nullptr;
+    Layer::Vec_t* vecOutput = nullptr;
+    Layer::Batch_t const* batchInput = nullptr;
+    Layer::Batch_t* batchOutput = nullptr;
+};
+
+
+// Inference over a copy of a DenseNN in which every layer whose weights take more than
+// cacheBytes is a ShardedLayer over threads pinned threads; the other layers run on the caller.
+// Only the shards hold the weights of a sharded layer.
+class ModelParallelNN {
+public:
+    ModelParallelNN(DenseNN const& network, Size_t threads, Size_t cacheBytes = Size_t(32) << 20);
+
+    Layer::Vec_t operator()(Layer::Vec_t const& input);
+    Layer::Batch_t operator()(Layer::Batch_t const& inputs);
+
+    Size_t shardedLayers() const;
+
+private:
+    Size_t inputSize;
+    std::vector<std::optional<Layer>> layers;          // copies of the layers run by the caller
+    std::vector<std::unique_ptr<ShardedLayer>> sharded; // null for the layers run by the caller
+};
@@ -1,10 +1,42 @@
+#pragma once
+
+#ifdef BACKPROP_WORK_STEALING
+#include <WorkStealingPool.hpp> // replaces Blaze's thread backend, before Blaze first uses it
+#endif
 #include <blaze/Blaze.h>
 #include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <vector>
 
 using Size_t = std::size_t;
 using Real_t = float;
 
 
+// Counter-based random numbers: draw `counter` of stream `key` is a pure function of the two
+// (the SplitMix64 mix), so a sample or a parameter draws its numbers on whatever thread handles
+// it, in any order, and gets the same ones.
+inline std::uint64_t counterRandom(std::uint64_t key, std::uint64_t counter)
+{
+    auto const mix = [](std::uint64_t z) {
+        z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+        z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+        return z ^ (z >> 31);
+    };
+    return mix(mix(key) + (counter + 1) * 0x9E3779B97F4A7C15ull);
+}
+
+inline Real_t counterUniform(std::uint64_t key, std::uint64_t counter) // in [0, 1)
+{
+    return Real_t(counterRandom(key, counter) >> 40) * Real_t(1.0 / (1 << 24));
+}
+
+
 struct SigmoidActivFn {
     static Real_t Activation(Real_t z) { return 1.f / (1.f + blaze::exp(-z)); }
     static Real_t Derivative(Real_t z)
@@ -15,14 +47,29 @@ struct SigmoidActivFn {
 };
 
 
+struct alignas(64) CacheLine_t {
+    Real_t values[64 / sizeof(Real_t)];
+};
+
+
+// The weights and biases of a layer are views, into a buffer of the layer's own or into the
+// ParameterArena of the network holding it. Copies of a layer get their own buffer.
 struct Layer {
     using Vec_t = blaze::DynamicVector<Real_t, true>;
-    using Weights_t = blaze::DynamicMatrix<Real_t>;
-    using Biases_t = Vec_t;
+    using SparseVec_t = blaze::CompressedVector<Real_t, true>;
+    using Batch_t = blaze::DynamicMatrix<Real_t>; // one sample per row
+    using SparseBatch_t = blaze::CompressedMatrix<Real_t>;
+    using Weights_t = blaze::CustomMatrix<Real_t, blaze::aligned, blaze::padded, blaze::rowMajor>;
+    using Biases_t = blaze::CustomVector<Real_t, blaze::aligned, blaze::padded, blaze::rowVector>;
     using ActivFn_t = Real_t (*)(Real_t);
     using ActivFnDeriv_t = ActivFn_t;
+    template <typename Input_t>
+    using Output_t = std::conditional_t<blaze::IsMatrix_v<Input_t>, Batch_t, Vec_t>;
 
     Layer(Size_t prevLayerSize, Size_t thisLayerSize, ActivFn_t aFn = nullptr, ActivFnDeriv_t aFnD = nullptr);
+    Layer(Layer const& other);
+    Layer(Layer&& other) noexcept = default;
+    Layer& operator=(Layer other) noexcept;
 
     template <typename ActFn_t = void>
     void setActivFn()
@@ -37,41 +84,559 @@ struct Layer {
         }
     }
 
+    // activations by the names they have in saved networks, "linear" for none; activationName
+    // returns nullptr for activations without a name, activationFns and setActivFn false for
+    // unknown names
+    static char const* activationName(ActivFn_t activFn);
+    static bool activationFns(std::string const& name, ActivFn_t& activFn, ActivFnDeriv_t& activFnDeriv);
+    bool setActivFn(std::string const& name);
+
+    // sparse inputs only touch the weight rows of their non-zero features
     std::pair<Layer::Vec_t, Layer::Vec_t> eval(Vec_t const& input) const; // {f(z), z}
+    std::pair<Layer::Vec_t, Layer::Vec_t> eval(SparseVec_t const& input) const;
+    std::pair<Layer::Batch_t, Layer::Batch_t> eval(Batch_t const& inputs) const;
+    std::pair<Layer::Batch_t, Layer::Batch_t> eval(SparseBatch_t const& inputs) const;
     Vec_t evalDerivZ(Vec_t const& z) const;
+    Batch_t evalDerivZ(Batch_t const& z) const;
+    // turns dE/df(z) into dE/dz in place, linear layers leave it as it is
+    void multiplyDerivZ(Vec_t const& z, Vec_t& derivative) const;
+    void multiplyDerivZ(Batch_t const& z, Batch_t& derivative) const;
+
+    // inference only, writes f(z) without keeping z
+    void infer(Batch_t const& inputs, Batch_t& outputs) const;
 
     Weights_t weights;
     Biases_t biases;
     ActivFn_t activFn;
     ActivFnDeriv_t activFnDeriv;
+
+private:
+    friend class DenseNN;
+
+    template <typename Input_t>
+    std::pair<Output_t<Input_t>, Output_t<Input_t>> evalImpl(Input_t const& input) const;
+
+    // points the views at the given blocks and frees the buffer of the layer's own
+    void bind(Weights_t& weightsBlock, Biases_t& biasesBlock);
+
+    std::vector<CacheLine_t> storage; // empty while the parameters are in an arena
+};
+
+
+// The weights and biases of a stack of layers (or the gradients of them) in one buffer of cache
+// lines: the weights of every layer, row after row with the rows padded as in Layer::Weights_t,
+// followed by its biases, each block starting on a line of its own. flat() views the whole buffer,
+// whose padding stays zero, so element-wise passes over all the parameters go through it at
+// once. Copies copy the buffer and view their copy.
+class ParameterArena {
+public:
+    using Flat_t = blaze::CustomVector<Real_t, blaze::aligned, blaze::unpadded, blaze::rowVector>;
+    using ConstFlat_t = blaze::CustomVector<Real_t const, blaze::aligned, blaze::unpadded, blaze::rowVector>;
+
+    ParameterArena() = default;
+    explicit ParameterArena(std::vector<Layer> const& layers); // zeroed, shaped like the layers
+    ParameterArena(ParameterArena const& other);
+    ParameterArena(ParameterArena&& other) noexcept = default;
+    ParameterArena& operator=(ParameterArena other) noexcept;
+
+    Flat_t flat() { return Flat_t(data(), size()); }
+    ConstFlat_t flat() const { return ConstFlat_t(data(), size()); }
+    Real_t* data() { return reinterpret_cast<Real_t*>(buffer.data()); }
+    Real_t const* data() const { return reinterpret_cast<Real_t const*>(buffer.data()); }
+    Size_t size() const { return buffer.size() * (sizeof(CacheLine_t) / sizeof(Real_t)); }
+
+    // same shapes of the same layers
+    bool sameLayout(ParameterArena const& other) const { return shapes == other.shapes; }
+
+    // blocks of every layer, their elements can be assigned but the views not be replaced
+    std::vector<Layer::Weights_t> weights;
+    std::vector<Layer::Biases_t> biases;
+
+private:
+    void bind(); // points the views at the buffer
+
+    std::vector<std::pair<Size_t, Size_t>> shapes; // rows and columns of the weights of every layer
+    std::vector<CacheLine_t> buffer;
+};
+
+
+// A loss compares the output layer's values of one sample with its target. Value returns the
+// loss of the sample and Delta writes dE/dz of the output layer; z, fz, target and delta hold size
+// values. Losses with a LinearOutput need a linear output layer and take its values as logits.
+struct MSELoss {
+    static constexpr bool LinearOutput = false;
+    static Real_t Value(Layer const& output, Real_t const* z, Real_t const* fz, Real_t const* target, Size_t size);
+    static void Delta(Layer const& output, Real_t const* z, Real_t const* fz, Real_t const* target, Real_t* delta, Size_t size);
+};
+
+
+// the target holds class probabilities, typically a one-hot vector
+struct SoftmaxCrossEntropyLoss {
+    static constexpr bool LinearOutput = true;
+    static Real_t Value(Layer const& output, Real_t const* z, Real_t const* fz, Real_t const* target, Size_t size);
+    static void Delta(Layer const& output, Real_t const* z, Real_t const* fz, Real_t const* target, Real_t* delta, Size_t size);
+};
+
+
+// every output is the logit of an independent binary label
+struct BinaryCrossEntropyLoss {
+    static constexpr bool LinearOutput = true;
+    static Real_t Value(Layer const& output, Real_t const* z, Real_t const* fz, Real_t const* target, Size_t size);
+    static void Delta(Layer const& output, Real_t const* z, Real_t const* fz, Real_t const* target, Real_t* delta, Size_t size);
+};
+
+
+// Updates parameter blocks (the weights or the biases of a layer) in place from their gradient.
+// Each block is identified by a slot owning its optimizer state, which is allocated zeroed on the
+// first update. Every kernel is a single fused SIMD pass over the parameters, the gradient and
+// the state.
+class Optimizer {
+public:
+    explicit Optimizer(Real_t learningRate) : learningRate(learningRate) {}
+    virtual ~Optimizer() = default;
+
+    virtual std::unique_ptr<Optimizer> clone() const = 0;
+
+    // has to be called once before the updates of every step
+    void nextStep() { ++step; }
+
+    // updates the size parameters starting at offset inside the slot's block of blockSize parameters,
+    // the gradient is multiplied by gradientScale on the fly; a new blockSize restarts the slot's state
+    void update(Size_t slot, Size_t blockSize, Size_t offset, Real_t* params, Real_t const* gradient, Size_t size,
+                Real_t gradientScale = 1);
+
+    void update(Size_t slot, Layer::Weights_t& params, Layer::Weights_t const& gradient, Real_t gradientScale = 1)
+    {
+        Size_t const size = params.rows() * params.spacing();
+        update(slot, size, 0, params.data(), gradient.data(), size, gradientScale);
+    }
+
+    void update(Size_t slot, Layer::Vec_t& params, Layer::Vec_t const& gradient, Real_t gradientScale = 1)
+    {
+        update(slot, params.size(), 0, params.data(), gradient.data(), params.size(), gradientScale);
+    }
+
+    Real_t learningRate;
+
+protected:
+    virtual Size_t stateCount() const = 0;
+    virtual void update(Real_t* params, Real_t const* gradient, Real_t gradientScale, Real_t* const* state, Size_t size) const = 0;
+
+    Size_t step = 0;
+
+private:
+    std::vector<std::vector<std::vector<Real_t>>> slots; // [slot][state][parameter]
+};
+
+
+// momentum == 0 gives the plain gradient descent
+class SGD : public Optimizer {
+public:
+    explicit SGD(Real_t learningRate = 0.1f, Real_t momentum = 0, bool nesterov = false)
+        : Optimizer(learningRate), momentum(momentum), nesterov(nesterov) {}
+
+    std::unique_ptr<Optimizer> clone() const override { return std::make_unique<SGD>(*this); }
+
+    Real_t momentum;
+    bool nesterov;
+
+protected:
+    Size_t stateCount() const override { return momentum ? 1 : 0; }
+    void update(Real_t* params, Real_t const* gradient, Real_t gradientScale, Real_t* const* state, Size_t size) const override;
+};
+
+
+class RMSProp : public Optimizer {
+public:
+    explicit RMSProp(Real_t learningRate = 0.001f, Real_t decay = 0.9f, Real_t epsilon = 1e-7f)
+        : Optimizer(learningRate), decay(decay), epsilon(epsilon) {}
+
+    std::unique_ptr<Optimizer> clone() const override { return std::make_unique<RMSProp>(*this); }
+
+    Real_t decay;
+    Real_t epsilon;
+
+protected:
+    Size_t stateCount() const override { return 1; }
+    void update(Real_t* params, Real_t const* gradient, Real_t gradientScale, Real_t* const* state, Size_t size) const override;
+};
+
+
+// weightDecay != 0 gives AdamW, the decay is decoupled from the gradient
+class Adam : public Optimizer {
+public:
+    explicit Adam(Real_t learningRate = 0.001f, Real_t beta1 = 0.9f, Real_t beta2 = 0.999f,
+                  Real_t epsilon = 1e-8f, Real_t weightDecay = 0)
+        : Optimizer(learningRate), beta1(beta1), beta2(beta2), epsilon(epsilon), weightDecay(weightDecay) {}
+
+    std::unique_ptr<Optimizer> clone() const override { return std::make_unique<Adam>(*this); }
+
+    Real_t beta1;
+    Real_t beta2;
+    Real_t epsilon;
+    Real_t weightDecay;
+
+protected:
+    Size_t stateCount() const override { return 2; }
+    void update(Real_t* params, Real_t const* gradient, Real_t gradientScale, Real_t* const* state, Size_t size) const override;
+};
+
+
+class AdamW : public Adam {
+public:
+    explicit AdamW(Real_t learningRate = 0.001f, Real_t weightDecay = 0.01f, Real_t beta1 = 0.9f,
+                   Real_t beta2 = 0.999f, Real_t epsilon = 1e-8f)
+        : Adam(learningRate, beta1, beta2, epsilon, weightDecay) {}
+
+    std::unique_ptr<Optimizer> clone() const override { return std::make_unique<AdamW>(*this); }
+};
+
+
+// Maps a bag of integer ids to the sum of their table rows. Only the rows of the ids seen in a
+// step are updated, with Adam whose per-row moments are decayed lazily for the skipped steps,
+// so a step costs O(touched rows) regardless of the vocabulary size.
+struct EmbeddingLayer {
+    using Table_t = blaze::DynamicMatrix<Real_t>;
+    using Ids_t = std::vector<Size_t>;
+
+    EmbeddingLayer(Size_t vocabularySize, Size_t dimension);
+
+    Layer::Vec_t eval(Ids_t const& ids) const;
+    void update(Ids_t const& ids, Layer::Vec_t const& outputDerivative);
+
+    Table_t table;
+    Real_t learningRate = 0.001f;
+    Real_t beta1 = 0.9f;
+    Real_t beta2 = 0.999f;
+    Real_t epsilon = 1e-8f;
+
+private:
+    Table_t firstMoments;
+    Table_t secondMoments;
+    std::vector<Size_t> lastSteps; // step of the last update of every row, 0 if never updated
+    Size_t step = 0;
+};
+
+
+// one sample per row
+struct Dataset {
+    Layer::Batch_t inputs;
+    Layer::Batch_t targets;
+};
+
+
+// Accuracy compares the argmax of the outputs and of the targets. For a single output, or for
+// BinaryCrossEntropyLoss, every output is a binary label instead, positive above 0.5 (0 for logits).
+struct Metrics {
+    Real_t loss = 0;
+    Real_t accuracy = 0;
+    Real_t meanAbsoluteError = 0;
 };
 
 
+class ExecutionPlan;
+
 class DenseNN {
 public:
+    using LossFn_t = Real_t (*)(Layer const&, Real_t const*, Real_t const*, Real_t const*, Size_t);
+    using LossDeltaFn_t = void (*)(Layer const&, Real_t const*, Real_t const*, Real_t const*, Real_t*, Size_t);
+
     DenseNN() = default;
+    DenseNN(DenseNN const& other);
+    DenseNN(DenseNN&& other);
+    DenseNN& operator=(DenseNN other);
 
     template <typename ActivFn_t = void>
     DenseNN& addLayer(Size_t size, Size_t inputSize = Size_t(-1))
     {
-        if (!layers.size() && inputSize == Size_t(-1))
+        if (!layers.size() && !embedding && inputSize == Size_t(-1))
             throw std::logic_error("First layer must provide a valid inputSize");
 
         if (layers.size())
             layers.emplace_back(layers.back().biases.size(), size);
         else
-            layers.emplace_back(inputSize, size);
+            layers.emplace_back(embedding ? embedding->table.columns() : inputSize, size);
         layers.back().setActivFn<ActivFn_t>();
+        pack();
+        return *this;
+    }
+
+    // the optimizer of the layers, plain gradient descent with a rate of 0.1 by default
+    template <typename Optimizer_t, typename... Args_t>
+    DenseNN& setOptimizer(Args_t&&... args)
+    {
+        optimizer = std::make_unique<Optimizer_t>(std::forward<Args_t>(args)...);
+        return *this;
+    }
+
+    // the loss minimized by learn, MSELoss by default
+    template <typename Loss_t>
+    DenseNN& setLoss()
+    {
+        lossFn = Loss_t::Value;
+        lossDeltaFn = Loss_t::Delta;
+        linearOutputLoss = Loss_t::LinearOutput;
+        return *this;
+    }
+
+    // the embedding becomes the first stage, it has to be added before any layer
+    DenseNN& addEmbedding(Size_t vocabularySize, Size_t dimension)
+    {
+        if (layers.size())
+            throw std::logic_error("Embedding must be added before the first layer");
+
+        embedding.emplace(vocabularySize, dimension);
+        return *this;
+    }
+
+    std::vector<Layer> const& getLayers() const { return layers; }
+
+    // Every weight and bias of the layers in one buffer. A copy of it is a checkpoint of the
+    // parameters, setParameters restores one of a network of the same shapes with a single copy.
+    ParameterArena const& parameters() const { return arena; }
+    void setParameters(ParameterArena const& checkpoint);
+
+    // Mean metrics of the network over the dataset. The rows are split across threads, each of which
+    // runs inference-only forward passes over batches of batchSize rows.
+    Metrics evaluate(Dataset const& dataset, Size_t threads = 0, Size_t batchSize = 256) const; // 0 threads: one per core
+
+    // Keeps z and f(z) only for the last segment of interval layers, and f(z) of the last layer of
+    // every other segment. The backward pass recomputes those segments from their checkpoint. 0 keeps
+    // the activations of every layer.
+    DenseNN& setCheckpointInterval(Size_t interval)
+    {
+        checkpointInterval = interval;
+        return *this;
+    }
+
+    // With plain SGD (no momentum), learn() subtracts the update of every layer from its weights as
+    // soon as the layer's delta is known, a rank-1 update for a sample and rank-k for a batch,
+    // instead of summing a weights-sized gradient and applying it in a second pass. Other
+    // optimizers keep the gradient.
+    DenseNN& setInPlaceUpdates(bool enabled)
+    {
+        inPlaceUpdates = enabled;
+        return *this;
+    }
+
+    // learnParallel() then sums the rows in blocks of blockRows whatever the thread count, every
+    // block on one thread, and adds the blocks up along a fixed pairwise tree, so the weights come
+    // out bit-identical for any number of threads and any schedule. 0 turns it off.
+    DenseNN& setDeterministic(Size_t blockRows)
+    {
+        deterministicBlockRows = blockRows;
         return *this;
     }
 
-    std::pair<std::vector<Layer::Weights_t>, std::vector<Layer::Vec_t>>
+    // weights uniform in [-1, 1) drawn from counterRandom(seed) by position, biases zero
+    DenseNN& randomize(std::uint64_t seed);
+
+    // activation memory and recomputation of one backward pass over a batch, computed from the shapes
+    struct CheckpointReport {
+        Size_t activationBytes = 0;     // peak of the activations kept at once
+        Size_t fullActivationBytes = 0; // the same without checkpointing
+        Size_t recomputedLayers = 0;    // layers evaluated twice per step
+        Size_t layers = 0;
+    };
+
+    CheckpointReport checkpointReport(Size_t batchSize = 1) const;
+
+    // Times every execution strategy of every layer shape at each batch size and keeps the fastest
+    // for the dense batch forward pass. With a path, a plan saved there on this machine that covers
+    // the shapes is loaded instead of retuning, otherwise the new plan is saved there.
+    ExecutionPlan const& tune(std::vector<Size_t> const& batchSizes = { 1, 32, 256 }, std::string const& path = "",
+                              Size_t maxThreads = 0); // 0 threads: one per core
+    DenseNN& setExecutionPlan(ExecutionPlan plan);
+
+    // Layer shapes, activations, weights and biases in a native-endian binary file. The embedding
+    // cannot be saved; the optimizer, the loss and the training state are not, loaded networks
+    // start with the defaults.
+    void save(std::string const& path) const;
+    static DenseNN load(std::string const& path);
+    // The network saved at model or, for "random:2,16,16,2", a new one with an input size of 2,
+    // sigmoid layers of 16 and 16 and a linear output layer of 2, as the tools take them
+    static DenseNN loadModel(std::string const& model);
+
+    // Sums of per-sample gradients in an arena laid out as the parameters of the network that made
+    // it. Summing any number of samples costs no memory beyond these buffers.
+    struct Gradient : ParameterArena {
+        Gradient() = default;
+        explicit Gradient(std::vector<Layer> const& layers) : ParameterArena(layers) {}
+
+        // adds the sums of another gradient of the same network, one pass over the flat buffers
+        Gradient& operator+=(Gradient const& other);
+
+        std::vector<Size_t> inputRows; // rows of weights.front() touched by sparse inputs
+        bool denseInput = false;       // weights.front() is dense once a dense input was added
+        Size_t samples = 0;
+    };
+
+    Gradient makeGradient() const; // zeroed buffers
+
+    std::pair<std::vector<blaze::DynamicMatrix<Real_t>>, std::vector<Layer::Vec_t>>
     gradient(Layer::Vec_t const& input, Layer::Vec_t const& targetOutput) const;
 
+    // adds the gradient of the sample (or of every row of the batch) to the buffers
+    void accumulateGradient(Layer::Vec_t const& input, Layer::Vec_t const& targetOutput, Gradient& gradient) const;
+
+    template <typename VT>
+    void accumulateGradient(blaze::SparseVector<VT, true> const& input, Layer::Vec_t const& targetOutput, Gradient& gradient) const
+    {
+        Layer::SparseVec_t const& in = ~input;
+        accumulateGradientImpl(in, targetOutput, gradient);
+    }
+
+    template <typename MT>
+    void accumulateGradient(blaze::Matrix<MT, blaze::rowMajor> const& inputs, Layer::Batch_t const& targetOutputs, Gradient& gradient) const
+    {
+        if constexpr (blaze::IsSparseMatrix_v<MT>) {
+            Layer::SparseBatch_t const& in = ~inputs;
+            accumulateGradientImpl(in, targetOutputs, gradient);
+        }
+        else {
+            Layer::Batch_t const& in = ~inputs;
+            accumulateGradientImpl(in, targetOutputs, gradient);
+        }
+    }
+
+    // Calls layerDone(s) as soon as the gradient of layer s is complete, from the last layer down,
+    // while the pass goes on below it, so the finished layers can already be sent elsewhere.
+    void accumulateGradient(Layer::Batch_t const& inputs, Layer::Batch_t const& targetOutputs, Gradient& gradient,
+                            std::function<void(Size_t layer)> const& layerDone) const;
+
+    // one optimizer step along the mean of the accumulated gradient, the buffers are zeroed afterwards
+    void applyGradient(Gradient& gradient);
+
     Layer::Vec_t operator()(Layer::Vec_t input) const;
 
+    // Queues the sample for an executor of the network that evaluates whatever is queued, up to
+    // AsyncBatchRows samples, as one batch on one of its threads (one per core), so the caller can
+    // go on while the sample is scored. The executor starts with the first submit; moves,
+    // assignments and the destructor run the queued samples first. As with concurrent calls to
+    // operator(), the network must not change while samples are queued. done is called on a
+    // thread of the executor; if the batch of the sample throws, or done does, failed gets the
+    // exception there instead, and the future holds it.
+    static constexpr Size_t AsyncBatchRows = 256;
+    std::future<Layer::Vec_t> submit(Layer::Vec_t input) const;
+    void submit(Layer::Vec_t input, std::function<void(Layer::Vec_t output)> done,
+                std::function<void(std::exception_ptr error)> failed = nullptr) const;
+
+    // templates only to stay out of the overload resolution of braced dense inputs
+    template <typename Ids_t, typename = std::enable_if_t<std::is_same_v<Ids_t, EmbeddingLayer::Ids_t>>>
+    Layer::Vec_t operator()(Ids_t const& ids) const
+    {
+        return (*this)(embed(ids));
+    }
+
+    template <typename VT>
+    Layer::Vec_t operator()(blaze::SparseVector<VT, true> const& input) const
+    {
+        Layer::SparseVec_t const& in = ~input;
+        return forward(in);
+    }
+
+    // evaluates every row of the (dense or sparse) batch
+    template <typename MT>
+    Layer::Batch_t operator()(blaze::Matrix<MT, blaze::rowMajor> const& inputs) const
+    {
+        if constexpr (blaze::IsSparseMatrix_v<MT>) {
+            Layer::SparseBatch_t const& in = ~inputs;
+            return forward(in);
+        }
+        else {
+            Layer::Batch_t const& in = ~inputs;
+            return forward(in);
+        }
+    }
+
     void learn(Layer::Vec_t const& input, Layer::Vec_t const& targetOutput);
 
+    template <typename Ids_t, typename = std::enable_if_t<std::is_same_v<Ids_t, EmbeddingLayer::Ids_t>>>
+    void learn(Ids_t const& ids, Layer::Vec_t const& targetOutput)
+    {
+        learnEmbedded(ids, targetOutput);
+    }
+
+    template <typename VT>
+    void learn(blaze::SparseVector<VT, true> const& input, Layer::Vec_t const& targetOutput)
+    {
+        Layer::SparseVec_t const& in = ~input;
+        learnImpl(in, targetOutput);
+    }
+
+    // learn() of the batch with its rows split over threads (0: one per core). Unless the network
+    // is deterministic, every thread sums its share of the rows and adds it to the total when it
+    // finishes, so the rounding of the sums depends on the thread count and on the schedule.
+    void learnParallel(Layer::Batch_t const& inputs, Layer::Batch_t const& targetOutputs, Size_t threads = 0);
+
+    // one step along the gradient averaged over the rows of the batch
+    template <typename MT>
+    void learn(blaze::Matrix<MT, blaze::rowMajor> const& inputs, Layer::Batch_t const& targetOutputs)
+    {
+        if constexpr (blaze::IsSparseMatrix_v<MT>) {
+            Layer::SparseBatch_t const& in = ~inputs;
+            learnImpl(in, targetOutputs);
+        }
+        else {
+            Layer::Batch_t const& in = ~inputs;
+            learnImpl(in, targetOutputs);
+        }
+    }
+
 private:
+    friend class PipelineTrainer;
+    class Executor;
+
+    static constexpr Size_t DeterministicSlots = 8; // blocks summed apart at once by learnParallel()
+
+    void swap(DenseNN& other); // everything but the executor
+    void pack(); // moves the parameters of the layers into a new arena
+    Executor& executorOf() const;
+
+    Layer::Vec_t embed(EmbeddingLayer::Ids_t const& ids) const;
+    void learnEmbedded(EmbeddingLayer::Ids_t const& ids, Layer::Vec_t const& targetOutput);
+
+    template <typename Input_t>
+    Layer::Output_t<Input_t> forward(Input_t const& input) const;
+    Layer::Batch_t forwardPlanned(Layer::Batch_t const& inputs) const;
+
+    // throws unless the targets hold one row of the output layer's size for each of the samples, the
+    // losses read them through raw pointers
+    void checkTargets(Size_t samples, Size_t targetRows, Size_t targetSize) const;
+
+    // calls consume(s, input of layer s, dE/dz of layer s) for every layer from the last one down,
+    // each once the delta of the layer below is known; inputDerivative (if given) receives dE/d(input)
+    template <typename Input_t, typename Consume_t>
+    void backprop(Input_t const& input, Layer::Output_t<Input_t> const& targetOutput, Consume_t consume,
+                  Layer::Output_t<Input_t>* inputDerivative = nullptr) const;
+
+    // adds the gradient of the sample to gradient
+    template <typename Input_t>
+    void backprop(Input_t const& input, Layer::Output_t<Input_t> const& targetOutput, Gradient& gradient,
+                  Layer::Output_t<Input_t>* inputDerivative = nullptr) const;
+
+    template <typename Input_t>
+    void accumulateGradientImpl(Input_t const& input, Layer::Output_t<Input_t> const& targetOutput, Gradient& gradient) const;
+
+    template <typename Input_t>
+    void learnImpl(Input_t const& input, Layer::Output_t<Input_t> const& targetOutput,
+                   Layer::Output_t<Input_t>* inputDerivative = nullptr);
+
+    std::optional<EmbeddingLayer> embedding;
     std::vector<Layer> layers;
-};
\ No newline at end of file
+    ParameterArena arena; // of the layers' parameters
+    std::unique_ptr<Optimizer> optimizer = std::make_unique<SGD>();
+    LossFn_t lossFn = MSELoss::Value;
+    LossDeltaFn_t lossDeltaFn = MSELoss::Delta;
+    bool linearOutputLoss = false;
+    Size_t checkpointInterval = 0;
+    bool inPlaceUpdates = false;
+    Size_t deterministicBlockRows = 0;
+    Gradient learnGradient;                 // reused by every learn() step
+    std::vector<Gradient> partialGradients; // of the blocks or threads of learnParallel()
+    std::shared_ptr<ExecutionPlan const> executionPlan; // shared by copies, it only depends on the shapes
+
+    // last, so that it finishes the queued samples before the layers are destroyed
+    mutable std::mutex executorMutex;
+    mutable std::shared_ptr<Executor> executor; // runs the submitted samples on this network
+};
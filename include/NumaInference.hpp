@@ -0,0 +1,46 @@
+#pragma once
+
+#include <Concurrency.hpp>
+#include <NeuralNetwork.hpp>
+#include <atomic>
+#include <functional>
+#include <future>
+#include <optional>
+#include <thread>
+
+
+// Inference workers pinned to the cpus of each NUMA node. The first worker of every node copies
+// the layers of the network itself, so the node's replica of the read-only weights and biases is
+// first-touched in the node's memory, and the workers of a node only ever read their own replica.
+class NumaInference {
+public:
+    // workersPerNode 0 starts one worker per cpu of the node
+    NumaInference(DenseNN const& network, Size_t workersPerNode = 0);
+    ~NumaInference();
+
+    // runs on the next node in round-robin order, the future holds the error of a failed batch
+    std::future<Layer::Batch_t> submit(Layer::Batch_t inputs);
+
+    // splits the rows across the nodes and waits for all of them
+    Layer::Batch_t operator()(Layer::Batch_t const& inputs);
+
+    Size_t nodeCount() const { return nodes.size(); }
+
+private:
+    using Task_t = std::function<void(std::vector<Layer> const&)>; // called with the node's replica
+
+    struct Node {
+        std::vector<Size_t> cpus;
+        std::vector<Layer> replica;
+        Channel<std::optional<Task_t>> tasks; // nullopt stops one worker
+        std::vector<std::thread> workers;
+    };
+
+    void run(Node& node, bool copiesReplica, std::promise<void>* replicaReady);
+    void checkInputs(Layer::Batch_t const& inputs) const; // throws std::logic_error
+
+    std::vector<Layer> const* source; // only during construction
+    Size_t inputSize = 0;
+    std::vector<std::unique_ptr<Node>> nodes;
+    std::atomic<Size_t> nextNode{ 0 };
+};
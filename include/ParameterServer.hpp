@@ -0,0 +1,127 @@
+#pragma once
+
+#include <NeuralNetwork.hpp>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <vector>
+
+
+// How the gradients pushed to a ParameterServer travel. TopK sends the topFraction of the values
+// largest in magnitude with their indices, Int8 sends every value as a byte scaled per block of
+// Int8Block values. Both run with error feedback, see GradientEncoder.
+struct GradientCompression {
+    enum Kind : std::uint32_t { None, TopK, Int8 };
+
+    static constexpr Size_t Int8Block = 256;
+
+    Kind kind = Int8;
+    Real_t topFraction = 0.01f;
+};
+
+
+// Compresses a stream of gradients of one size with error feedback: what a message leaves out of a
+// gradient is added to the next one, so the compression delays parts of the gradients instead
+// of losing them.
+class GradientEncoder {
+public:
+    GradientEncoder(GradientCompression compression, Size_t size);
+
+    // bytes receives the message of scale * values plus the residual of the earlier messages
+    void encode(Real_t const* values, Real_t scale, std::vector<std::uint8_t>& bytes);
+    // adds the values of a message to values, false when it is malformed for size values
+    static bool decode(GradientCompression::Kind kind, std::vector<std::uint8_t> const& bytes, Real_t* values, Size_t size);
+    // whether a message of the kind can take bytes for size values
+    static bool sizeMatches(GradientCompression::Kind kind, Size_t bytes, Size_t size);
+
+    GradientCompression::Kind kind() const { return compression.kind; }
+    Size_t size() const { return residual.size(); }
+
+private:
+    GradientCompression const compression;
+    std::vector<Real_t> residual;
+    std::vector<std::uint32_t> order; // scratch of TopK
+};
+
+
+// Holds the authoritative parameters of a DenseNN for worker processes that pull them and push
+// gradients over a Unix socket, each at its own pace: every push is applied on arrival with the
+// optimizer of the network. The clock of a worker counts its pushes; under stale synchronous
+// parallelism a pull waits while its worker is more than staleness clocks ahead of the slowest one
+// still connected, which bounds how old the weights behind any applied gradient can be.
+class ParameterServer {
+public:
+    struct Options {
+        Size_t workers = 1;   // served by run()
+        Size_t staleness = 2; // clocks a worker may lead the slowest one by
+    };
+
+    struct Stats {
+        Size_t pushes = 0;
+        Size_t pulls = 0;
+        Size_t gradientBytes = 0; // received in the pushes
+        Size_t denseBytes = 0;    // the same gradients would have taken as floats
+        Size_t maxStaleness = 0;  // updates applied between the pull and the push of a gradient
+        double heldSeconds = 0;   // pulls spent waiting for the slowest worker
+    };
+
+    ParameterServer(DenseNN network, std::string const& path, Options options);
+    ~ParameterServer();
+    ParameterServer(ParameterServer const&) = delete;
+    ParameterServer& operator=(ParameterServer const&) = delete;
+
+    // accepts options.workers connections and serves them until all of them are closed
+    void run();
+
+    DenseNN model() const; // a copy of the parameters as they are
+    Stats stats() const;
+
+private:
+    void serve(Size_t worker, int fd);
+    void leave(Size_t worker);
+    Size_t slowestClock() const; // of the connected workers
+
+    std::string const path;
+    Options const options;
+    int listener = -1;
+
+    mutable std::mutex mutex;
+    std::condition_variable advanced;
+    DenseNN network;
+    Size_t version = 0;         // updates applied
+    std::vector<Size_t> clocks; // of every worker
+    std::vector<bool> left;     // workers whose connection closed
+    Stats counters;
+};
+
+
+// The worker side of a ParameterServer connection. The gradients leave as soon as they are
+// encoded, the server applies them while the worker goes on with its next step.
+class ParameterClient {
+public:
+    // retries until the server listens, up to timeout
+    explicit ParameterClient(std::string const& path, GradientCompression compression = {},
+                             std::chrono::milliseconds timeout = std::chrono::seconds(10));
+    ~ParameterClient();
+    ParameterClient(ParameterClient const&) = delete;
+    ParameterClient& operator=(ParameterClient const&) = delete;
+
+    // throw std::runtime_error once the server is gone
+    void pull(DenseNN& network);            // the latest parameters the staleness bound allows
+    void push(DenseNN::Gradient& gradient); // the mean of the summed gradient, which is zeroed
+
+    Size_t clock() const { return pushes; }
+    Size_t bytesSent() const { return sent; } // of the gradients
+
+private:
+    int fd = -1;
+    GradientCompression const compression;
+    std::optional<GradientEncoder> encoder;
+    std::vector<std::uint8_t> message;
+    Size_t pushes = 0;
+    Size_t version = 0; // of the pulled parameters
+    Size_t sent = 0;
+};
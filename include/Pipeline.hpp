@@ -0,0 +1,64 @@
+#pragma once
+
+#include <Concurrency.hpp>
+#include <NeuralNetwork.hpp>
+#include <exception>
+#include <optional>
+#include <thread>
+
+
+// Trains a DenseNN whose layers are split into contiguous stages, balanced by weight count. Each
+// stage is owned by a thread pinned to its own core, so its weights stay in that core's cache.
+// Micro-batches stream through the stages: a stage handles forward and backward messages as they
+// arrive, and the last stage starts the backward pass of a micro-batch right after its forward
+// pass, so the passes of different micro-batches overlap.
+class PipelineTrainer {
+public:
+    struct Report {
+        Real_t bubbleFraction = 0;            // idle share of the stages' time
+        std::vector<Real_t> stageUtilization; // busy share of the time of every stage
+    };
+
+    PipelineTrainer(DenseNN& network, Size_t stageCount);
+    ~PipelineTrainer();
+
+    // one optimizer step along the gradient averaged over the batch; an exception of a stage is
+    // rethrown once every stage is idle, and the step is not taken
+    void learn(Layer::Batch_t const& inputs, Layer::Batch_t const& targets, Size_t microBatches);
+
+    Report report() const; // over every learn call so far
+
+    // first layer of every stage, followed by the layer count
+    std::vector<Size_t> stageBoundaries() const;
+
+private:
+    struct Message {
+        bool backward;
+        Size_t microBatch;
+        Layer::Batch_t values; // f(z) of the previous stage, or dE/df(z) of this stage's output
+        std::exception_ptr error = nullptr; // of an earlier stage, the message only passes on
+    };
+
+    struct Stage {
+        Size_t begin;
+        Size_t end;
+        Channel<std::optional<Message>> inbox; // nullopt stops the thread
+        std::vector<Layer::Batch_t> inputs;    // [micro-batch]
+        std::vector<std::vector<std::pair<Layer::Batch_t, Layer::Batch_t>>> activations; // [micro-batch][layer] {f(z), z}
+        double busySeconds = 0;
+        std::thread thread;
+    };
+
+    void run(Size_t stage);
+    void forward(Stage& stage, Message& message);
+    void backward(Stage& stage, Size_t microBatch, Layer::Batch_t upstream);
+    void passOn(Stage& stage, Message const& message, std::exception_ptr error);
+
+    DenseNN& network;
+    std::vector<std::unique_ptr<Stage>> stages;
+    DenseNN::Gradient gradient;
+    Layer::Batch_t const* targets = nullptr; // of the running learn call
+    std::vector<Size_t> microBatchRows;      // first row of every micro-batch, followed by the row count
+    Channel<std::exception_ptr> handled;     // error of every message handled, after its busy time is added
+    double wallSeconds = 0;
+};
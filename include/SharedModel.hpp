@@ -0,0 +1,47 @@
+#pragma once
+
+#include <NeuralNetwork.hpp>
+#include <string>
+#include <vector>
+
+
+// A DenseNN published once into POSIX shared memory under /backprop.<name>. Every process that
+// opens it maps the same pages read-only and evaluates the layers through CustomMatrix views of
+// the mapping, so N worker processes hold one copy of the weights. Rows of the weights start
+// on 64 byte boundaries, so the views are aligned for Blaze's SIMD kernels.
+class SharedModel {
+public:
+    // replaces a model of the same name, processes that opened the old one keep their mapping
+    static void publish(std::string const& name, DenseNN const& network);
+    static void remove(std::string const& name);
+    static SharedModel open(std::string const& name);
+
+    SharedModel(SharedModel&& other);
+    SharedModel& operator=(SharedModel&& other);
+    ~SharedModel();
+
+    Layer::Vec_t operator()(Layer::Vec_t const& input) const;
+    Layer::Batch_t operator()(Layer::Batch_t const& inputs) const;
+
+    Size_t inputSize() const { return layers.front().weights.rows(); }
+    Size_t layerCount() const { return layers.size(); }
+    Size_t bytes() const { return size; } // of the mapping, shared by every process
+
+private:
+    // the mapping is read-only: padded views would clear their padding on construction, so the
+    // views are unpadded even though the publisher zeroed the padding of every row
+    using WeightsView_t = blaze::CustomMatrix<Real_t, blaze::aligned, blaze::unpadded, blaze::rowMajor>;
+    using BiasesView_t = blaze::CustomVector<Real_t, blaze::aligned, blaze::unpadded, true>;
+
+    struct LayerView {
+        WeightsView_t weights;
+        BiasesView_t biases;
+        Layer::ActivFn_t activFn;
+    };
+
+    SharedModel(void* mapping, Size_t size);
+
+    void* mapping = nullptr;
+    Size_t size = 0;
+    std::vector<LayerView> layers;
+};
@@ -0,0 +1,108 @@
+#pragma once
+
+#include <Concurrency.hpp>
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+
+// A drop-in for blaze::ThreadPool (size, resize, schedule, wait) built for many small tasks: every
+// worker runs the tasks of its own Chase-Lev deque and steals from the others when it runs dry,
+// so the workers take tasks without a shared lock. Tasks scheduled from outside the pool land on a
+// lock-free stack that the first idle worker takes whole; tasks scheduled by tasks go to the deque
+// of their worker. Idle workers spin for a while before they park on a condition variable, so
+// bursts of tasks do not pay for wakeups, and wait() helps by stealing tasks until all are done.
+class WorkStealingPool {
+public:
+    explicit WorkStealingPool(std::size_t threads);
+    WorkStealingPool(WorkStealingPool const&) = delete;
+    WorkStealingPool& operator=(WorkStealingPool const&) = delete;
+    ~WorkStealingPool(); // waits for the scheduled tasks
+
+    std::size_t size() const { return workers.size(); }
+
+    // waits for the scheduled tasks first, the block flag of blaze::ThreadPool is implied
+    void resize(std::size_t threads, bool block = false);
+
+    template <typename Callable, typename... Args>
+    void schedule(Callable func, Args&&... args)
+    {
+        push(new Task{ std::bind(std::move(func), std::forward<Args>(args)...), nullptr });
+    }
+
+    // every task scheduled so far has finished, not to be called by the tasks themselves
+    void wait();
+
+private:
+    struct Task {
+        std::function<void()> run;
+        Task* next; // on the stack of tasks from outside the pool
+    };
+
+    struct Worker {
+        ChaseLevDeque<Task> tasks;
+        std::thread thread;
+    };
+
+    void start(std::size_t threads);
+    void stop();
+    void push(Task* task);
+    Task* find(std::size_t self);
+    Task* steal(std::size_t first);
+    void run(Task* task);
+    void work(std::size_t self);
+
+    std::vector<std::unique_ptr<Worker>> workers;
+    std::atomic<Task*> injected{ nullptr };
+    std::size_t spinRounds = 0;
+
+    std::atomic<std::size_t> queued{ 0 };     // scheduled and not yet taken, parked workers wake on it
+    std::atomic<std::size_t> unfinished{ 0 }; // scheduled and not yet finished, wait() returns on 0
+    std::atomic<std::size_t> sleepers{ 0 };
+    std::atomic<std::size_t> waiters{ 0 };
+    std::atomic<bool> stopping{ false };
+    std::mutex parking;
+    std::condition_variable wakeUp;
+    std::condition_variable finished;
+};
+
+
+#if defined(BACKPROP_WORK_STEALING) && defined(BLAZE_USE_CPP_THREADS)
+#include <algorithm>
+#include <blaze/math/smp/threads/ThreadBackend.h>
+#include <cstdlib>
+
+// Blaze's C++11 thread backend, which every SMP assignment of Blaze runs on, on a WorkStealingPool.
+// Explicit specializations have to come before their first use, so this header has to be
+// included before Blaze's math headers, as NeuralNetwork.hpp does.
+namespace blaze {
+
+template <>
+class ThreadBackend<std::thread, std::mutex, std::unique_lock<std::mutex>, std::condition_variable> {
+public:
+    static std::size_t size() { return pool().size(); }
+    static void resize(std::size_t n, bool block = false) { pool().resize(n, block); }
+    static void wait() { pool().wait(); }
+
+    template <typename Target, typename Source, typename OP>
+    static void schedule(Target& target, Source const& source, OP op)
+    {
+        pool().schedule([target, source, op]() mutable { op(target, source); });
+    }
+
+private:
+    static WorkStealingPool& pool()
+    {
+        // BLAZE_NUM_THREADS threads, one if unset, as Blaze's own backend
+        static WorkStealingPool threads(std::getenv("BLAZE_NUM_THREADS") ? std::max(1, std::atoi(std::getenv("BLAZE_NUM_THREADS"))) : 1);
+        return threads;
+    }
+};
+
+} // namespace blaze
+#endif
@@ -0,0 +1,132 @@
+#include <NeuralNetwork.hpp>
+#include <algorithm>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <stdexcept>
+#include <thread>
+
+// Greedy batching: a thread takes everything queued (up to AsyncBatchRows samples) as soon as it
+// is free, so an idle network answers single samples at once and a loaded one batches them.
+class DenseNN::Executor {
+public:
+    explicit Executor(DenseNN const& network) : network(network)
+    {
+        Size_t const count = std::max(1u, std::thread::hardware_concurrency());
+        for (Size_t i = 0; i < count; ++i)
+            workers.emplace_back(&Executor::run, this);
+    }
+
+    ~Executor()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+        }
+        queued.notify_all();
+        for (auto& worker : workers)
+            worker.join();
+    }
+
+    void submit(Layer::Vec_t input, std::function<void(Layer::Vec_t)> done, std::function<void(std::exception_ptr)> failed)
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            requests.push_back({ std::move(input), std::move(done), std::move(failed) });
+        }
+        queued.notify_one();
+    }
+
+private:
+    struct Request {
+        Layer::Vec_t input;
+        std::function<void(Layer::Vec_t)> done;
+        std::function<void(std::exception_ptr)> failed;
+    };
+
+    // an error reaches the request's failed callback, the worker goes on with the next request
+    static void fail(Request const& request, std::exception_ptr error)
+    {
+        if (!request.failed)
+            return;
+        try {
+            request.failed(error);
+        }
+        catch (...) {
+        }
+    }
+
+    void run()
+    {
+        std::vector<Request> batch;
+        Layer::Batch_t inputs, outputs;
+        for (;;) {
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                queued.wait(lock, [this] { return !requests.empty() || stopping; });
+                if (requests.empty())
+                    return;
+                Size_t const rows = std::min(requests.size(), AsyncBatchRows);
+                batch.assign(std::make_move_iterator(requests.begin()), std::make_move_iterator(requests.begin() + rows));
+                requests.erase(requests.begin(), requests.begin() + rows);
+            }
+            // the rest is for the next free thread
+            queued.notify_one();
+
+            try {
+                inputs.resize(batch.size(), network.layers.front().weights.rows(), false);
+                for (Size_t i = 0; i < batch.size(); ++i)
+                    blaze::row(inputs, i) = batch[i].input;
+                outputs = network(inputs);
+            }
+            catch (...) {
+                for (auto const& request : batch)
+                    fail(request, std::current_exception());
+                batch.clear();
+                continue;
+            }
+            for (Size_t i = 0; i < batch.size(); ++i)
+                try {
+                    batch[i].done(Layer::Vec_t(blaze::row(outputs, i)));
+                }
+                catch (...) {
+                    fail(batch[i], std::current_exception());
+                }
+            batch.clear();
+        }
+    }
+
+    DenseNN const& network;
+    std::mutex mutex;
+    std::condition_variable queued;
+    std::deque<Request> requests;
+    bool stopping = false;
+    std::vector<std::thread> workers;
+};
+
+DenseNN::Executor& DenseNN::executorOf() const
+{
+    std::lock_guard<std::mutex> lock(executorMutex);
+    if (!executor)
+        executor = std::make_shared<Executor>(*this);
+    return *executor;
+}
+
+void DenseNN::submit(Layer::Vec_t input, std::function<void(Layer::Vec_t output)> done,
+                     std::function<void(std::exception_ptr error)> failed) const
+{
+    if (layers.empty())
+        throw std::logic_error("Network has no layers");
+    if (input.size() != layers.front().weights.rows())
+        throw std::logic_error("Input size does not match the first layer");
+    executorOf().submit(std::move(input), std::move(done), std::move(failed));
+}
+
+std::future<Layer::Vec_t> DenseNN::submit(Layer::Vec_t input) const
+{
+    auto promise = std::make_shared<std::promise<Layer::Vec_t>>();
+    auto future = promise->get_future();
+    submit(std::move(input), [promise](Layer::Vec_t output) { promise->set_value(std::move(output)); },
+           [promise](std::exception_ptr error) { promise->set_exception(error); });
+    return future;
+}
@@ -0,0 +1,170 @@
+#include <BatchScheduler.hpp>
+#include <algorithm>
+
+namespace {
+
+Size_t inputSizeOf(DenseNN const& network)
+{
+    if (network.getLayers().empty())
+        throw std::logic_error("Network has no layers");
+    return network.getLayers().front().weights.rows();
+}
+
+} // namespace
+
+BatchScheduler::BatchScheduler(DenseNN network, Options options)
+    : inputCount(inputSizeOf(network)),
+      model(std::move(network)),
+      options(options)
+{
+    if (!options.maxRows)
+        throw std::logic_error("Batches need at least one row");
+
+    Size_t const count = options.workers ? options.workers : std::max(1u, std::thread::hardware_concurrency());
+    for (Size_t i = 0; i < count; ++i)
+        workers.emplace_back(&BatchScheduler::run, this);
+}
+
+BatchScheduler::~BatchScheduler()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    queued.notify_all();
+    for (auto& worker : workers)
+        worker.join();
+}
+
+void BatchScheduler::submit(Layer::Vec_t input, Callback_t done, Clock_t::time_point deadline, int priority)
+{
+    if (input.size() != inputSize())
+        throw std::logic_error("Input size does not match the first layer");
+
+    auto const now = Clock_t::now();
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        requests.insert(Request{ priority, deadline, sequence++, now, std::move(input), std::move(done) });
+        arrivals.insert(now);
+    }
+    queued.notify_one();
+}
+
+std::future<Layer::Vec_t> BatchScheduler::submit(Layer::Vec_t input, Clock_t::time_point deadline, int priority)
+{
+    auto promise = std::make_shared<std::promise<Layer::Vec_t>>();
+    auto future = promise->get_future();
+    submit(
+        std::move(input),
+        [promise](std::optional<Layer::Vec_t> output, std::exception_ptr error) {
+            if (output)
+                promise->set_value(std::move(*output));
+            else
+                promise->set_exception(error);
+        },
+        deadline, priority);
+    return future;
+}
+
+void BatchScheduler::swapModel(DenseNN network)
+{
+    if (inputSizeOf(network) != inputCount)
+        throw std::logic_error("The new network does not take the inputs of the old one");
+    model.swap(std::move(network));
+}
+
+BatchScheduler::Stats BatchScheduler::stats() const
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return counters;
+}
+
+// wakeUp receives the time at which a batch becomes ready if it is not yet
+bool BatchScheduler::batchReady(Clock_t::time_point now, Clock_t::time_point& wakeUp) const
+{
+    if (requests.empty())
+        return stopping;
+    if (requests.size() >= options.maxRows || stopping)
+        return true;
+
+    Clock_t::time_point const urgent = requests.begin()->deadline;
+    Clock_t::time_point const flush = *arrivals.begin() + options.maxDelay;
+    bool const deadlineClose = urgent != Clock_t::time_point::max() && urgent - options.maxDelay <= now;
+    wakeUp = urgent == Clock_t::time_point::max() ? flush : std::min(flush, urgent - options.maxDelay);
+    return deadlineClose || flush <= now;
+}
+
+void BatchScheduler::fail(Request const& request, std::exception_ptr error)
+{
+    try {
+        request.done(std::nullopt, error);
+    }
+    catch (...) {
+    }
+}
+
+void BatchScheduler::run()
+{
+    std::vector<Request> batch;
+    std::vector<Request> missed;
+    for (;;) {
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            for (;;) {
+                auto const now = Clock_t::now();
+                Clock_t::time_point wakeUp;
+                if (batchReady(now, wakeUp))
+                    break;
+                if (requests.empty())
+                    queued.wait(lock);
+                else
+                    queued.wait_until(lock, wakeUp);
+            }
+            if (requests.empty())
+                return;
+
+            auto const now = Clock_t::now();
+            while (!requests.empty() && batch.size() < options.maxRows) {
+                auto node = requests.extract(requests.begin());
+                arrivals.erase(arrivals.find(node.value().arrival));
+                (node.value().deadline < now ? missed : batch).push_back(std::move(node.value()));
+            }
+            counters.requests += batch.size() + missed.size();
+            counters.missedDeadlines += missed.size();
+            counters.batches += !batch.empty();
+        }
+        // the remaining requests may already make another batch
+        queued.notify_one();
+
+        for (auto const& request : missed)
+            fail(request, std::make_exception_ptr(DeadlineMissed()));
+        missed.clear();
+        if (batch.empty())
+            continue;
+
+        Layer::Batch_t outputs;
+        try {
+            Layer::Batch_t inputs(batch.size(), inputSize());
+            for (Size_t i = 0; i < batch.size(); ++i)
+                blaze::row(inputs, i) = batch[i].input;
+            outputs = (*model.read())(inputs);
+        }
+        catch (...) {
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                counters.failures += batch.size();
+            }
+            for (auto const& request : batch)
+                fail(request, std::current_exception());
+            batch.clear();
+            continue;
+        }
+        for (Size_t i = 0; i < batch.size(); ++i)
+            try {
+                batch[i].done(Layer::Vec_t(blaze::row(outputs, i)), nullptr);
+            }
+            catch (...) {
+            }
+        batch.clear();
+    }
+}
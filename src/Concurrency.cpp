@@ -0,0 +1,70 @@
+#include <Concurrency.hpp>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <thread>
+
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+namespace {
+
+std::size_t cpuCount() { return std::max(1u, std::thread::hardware_concurrency()); }
+
+// "0-3,8,10-11"
+std::vector<std::size_t> parseCpuList(std::string const& list)
+{
+    std::vector<std::size_t> cpus;
+    std::stringstream stream(list);
+    std::string range;
+    while (std::getline(stream, range, ',')) {
+        auto const dash = range.find('-');
+        std::size_t const first = std::stoul(range.substr(0, dash));
+        std::size_t const last = dash == std::string::npos ? first : std::stoul(range.substr(dash + 1));
+        for (std::size_t cpu = first; cpu <= last; ++cpu)
+            cpus.push_back(cpu);
+    }
+    return cpus;
+}
+
+} // namespace
+
+bool pinCurrentThread(std::size_t cpu)
+{
+    return pinCurrentThread(std::vector<std::size_t>{ cpu % cpuCount() });
+}
+
+bool pinCurrentThread(std::vector<std::size_t> const& cpus)
+{
+#ifdef __linux__
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    for (std::size_t cpu : cpus)
+        CPU_SET(cpu, &set);
+    return !pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+#else
+    return false;
+#endif
+}
+
+std::vector<std::vector<std::size_t>> numaNodes()
+{
+    std::vector<std::vector<std::size_t>> nodes;
+    for (std::size_t node = 0;; ++node) {
+        std::ifstream file("/sys/devices/system/node/node" + std::to_string(node) + "/cpulist");
+        std::string list;
+        if (!std::getline(file, list))
+            break;
+        if (!list.empty())
+            nodes.push_back(parseCpuList(list));
+    }
+
+    if (nodes.empty()) {
+        nodes.emplace_back();
+        for (std::size_t cpu = 0; cpu < cpuCount(); ++cpu)
+            nodes.back().push_back(cpu);
+    }
+    return nodes;
+}
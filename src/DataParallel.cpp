@@ -0,0 +1,253 @@
+#include <DataParallel.hpp>
+#include <InferenceProtocol.hpp>
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <exception>
+#include <stdexcept>
+
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+namespace {
+
+using Clock_t = std::chrono::steady_clock;
+
+double secondsSince(Clock_t::time_point start) { return std::chrono::duration<double>(Clock_t::now() - start).count(); }
+
+std::string endpoint(std::string const& path, Size_t rank) { return path + "." + std::to_string(rank); }
+
+void setNonBlocking(int fd)
+{
+    if (::fcntl(fd, F_SETFL, ::fcntl(fd, F_GETFL) | O_NONBLOCK))
+        throw std::runtime_error(std::string("fcntl: ") + std::strerror(errno));
+}
+
+[[noreturn]] void peerFailed(char const* call)
+{
+    throw std::runtime_error(std::string("Ring peer failed in ") + call + ": " + (errno ? std::strerror(errno) : "closed"));
+}
+
+// [begin, end) of chunk i of a buffer of size values split over ranks
+std::pair<Size_t, Size_t> chunk(Size_t i, Size_t size, Size_t ranks)
+{
+    i %= ranks;
+    return { size * i / ranks, size * (i + 1) / ranks };
+}
+
+} // namespace
+
+RingAllreduce::RingAllreduce(Size_t rank, Size_t ranks, std::string const& path, std::chrono::milliseconds timeout)
+    : self(rank),
+      count(ranks)
+{
+    if (!ranks || rank >= ranks)
+        throw std::logic_error("The rank is not in the ring");
+    if (ranks == 1)
+        return;
+
+    // the listening socket queues the connection of the previous rank until it is accepted
+    int const listener = protocol::listenUnix(endpoint(path, rank));
+    try {
+        auto const deadline = Clock_t::now() + timeout;
+        while (next < 0)
+            try {
+                next = protocol::connectUnix(endpoint(path, (rank + 1) % ranks));
+            }
+            catch (std::runtime_error const&) {
+                if (Clock_t::now() > deadline)
+                    throw;
+                std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            }
+        while (previous < 0) {
+            auto const left = std::chrono::ceil<std::chrono::milliseconds>(deadline - Clock_t::now()).count();
+            pollfd waiting{ listener, POLLIN, 0 };
+            int const ready = left > 0 ? ::poll(&waiting, 1, int(left)) : 0;
+            if (!ready)
+                throw std::runtime_error("The previous rank did not connect in time");
+            if (ready < 0 && errno != EINTR)
+                throw std::runtime_error(std::string("poll: ") + std::strerror(errno));
+            if (ready > 0 && (previous = ::accept(listener, nullptr, nullptr)) < 0 && errno != EINTR)
+                throw std::runtime_error(std::string("accept: ") + std::strerror(errno));
+        }
+        setNonBlocking(next);
+        setNonBlocking(previous);
+    }
+    catch (...) {
+        ::close(listener);
+        ::unlink(endpoint(path, rank).c_str());
+        if (next >= 0)
+            ::close(next);
+        if (previous >= 0)
+            ::close(previous);
+        throw;
+    }
+    ::close(listener);
+    ::unlink(endpoint(path, rank).c_str());
+}
+
+RingAllreduce::~RingAllreduce()
+{
+    if (next >= 0)
+        ::close(next);
+    if (previous >= 0)
+        ::close(previous);
+}
+
+// Sends sendCount values to the next rank while receiving receiveCount from the previous one, in
+// segments of at most SegmentBytes each way. arrived(first, end) is called for every run of
+// values received whole, so they are used while the rest is on the way.
+template <typename Arrived_t>
+void RingAllreduce::exchange(Real_t const* send, Size_t sendCount, Real_t* receive, Size_t receiveCount, Arrived_t arrived)
+{
+    auto const* out = reinterpret_cast<char const*>(send);
+    auto* in = reinterpret_cast<char*>(receive);
+    Size_t toSend = sendCount * sizeof(Real_t);
+    Size_t const toReceive = receiveCount * sizeof(Real_t);
+    Size_t received = 0;
+    Size_t reported = 0;
+
+    while (toSend || received < toReceive) {
+        pollfd fds[2] = { { toSend ? next : -1, POLLOUT, 0 }, { received < toReceive ? previous : -1, POLLIN, 0 } };
+        if (::poll(fds, 2, -1) < 0) {
+            if (errno == EINTR)
+                continue;
+            peerFailed("poll");
+        }
+
+        if (fds[0].revents) {
+            ssize_t const sent = ::send(next, out, std::min(toSend, SegmentBytes), MSG_NOSIGNAL);
+            if (sent < 0 && errno != EAGAIN && errno != EINTR)
+                peerFailed("send");
+            if (sent > 0) {
+                out += sent;
+                toSend -= sent;
+            }
+        }
+        if (fds[1].revents) {
+            errno = 0;
+            ssize_t const got = ::recv(previous, in + received, std::min(toReceive - received, SegmentBytes), 0);
+            if (got == 0 || (got < 0 && errno != EAGAIN && errno != EINTR))
+                peerFailed("recv");
+            if (got > 0) {
+                received += got;
+                if (Size_t const whole = received / sizeof(Real_t); whole > reported) {
+                    arrived(reported, whole);
+                    reported = whole;
+                }
+            }
+        }
+    }
+}
+
+void RingAllreduce::allreduce(Real_t* data, Size_t size)
+{
+    if (count == 1)
+        return;
+
+    // reduce-scatter: after step k, chunk rank - k - 1 holds the sum of k + 2 ranks, the one of
+    // rank + 1 holds the total at the end
+    incoming.resize(size / count + 1);
+    for (Size_t k = 0; k + 1 < count; ++k) {
+        auto const [sendBegin, sendEnd] = chunk(self + count - k, size, count);
+        auto const [receiveBegin, receiveEnd] = chunk(self + count - k - 1, size, count);
+        Real_t* const sum = data + receiveBegin;
+        exchange(data + sendBegin, sendEnd - sendBegin, incoming.data(), receiveEnd - receiveBegin, [&](Size_t first, Size_t end) {
+            for (Size_t i = first; i < end; ++i)
+                sum[i] += incoming[i];
+        });
+    }
+
+    // all-gather: the totals go once around the ring
+    for (Size_t k = 0; k + 1 < count; ++k) {
+        auto const [sendBegin, sendEnd] = chunk(self + 1 + count - k, size, count);
+        auto const [receiveBegin, receiveEnd] = chunk(self + count - k, size, count);
+        exchange(data + sendBegin, sendEnd - sendBegin, data + receiveBegin, receiveEnd - receiveBegin, [](Size_t, Size_t) {});
+    }
+}
+
+void RingAllreduce::broadcast(Real_t* data, Size_t size)
+{
+    if (count == 1)
+        return;
+    if (self)
+        exchange(nullptr, 0, data, size, [](Size_t, Size_t) {});
+    if (self + 1 != count)
+        exchange(data, size, nullptr, 0, [](Size_t, Size_t) {});
+}
+
+DataParallelTrainer::DataParallelTrainer(DenseNN& network, RingAllreduce& ring, Size_t bucketFloats)
+    : network(network),
+      ring(ring),
+      bucketFloats(bucketFloats),
+      gradient(network.makeGradient())
+{
+    ParameterArena parameters = network.parameters();
+    ring.broadcast(parameters.data(), parameters.size());
+    network.setParameters(parameters);
+
+    thread = std::thread(&DataParallelTrainer::run, this);
+}
+
+DataParallelTrainer::~DataParallelTrainer()
+{
+    buckets.push(std::nullopt);
+    thread.join();
+}
+
+void DataParallelTrainer::learn(Layer::Batch_t const& inputs, Layer::Batch_t const& targets)
+{
+    auto const start = Clock_t::now();
+    auto const offset = [&](Size_t s) {
+        return Size_t((s < gradient.weights.size() ? gradient.weights[s].data() : gradient.data() + gradient.size()) - gradient.data());
+    };
+
+    // the layers finish from the last one down, so the pending ones make one range of the arena
+    Size_t pendingEnd = gradient.size();
+    Size_t bucketCount = 0;
+    network.accumulateGradient(inputs, targets, gradient, [&](Size_t s) {
+        if (pendingEnd - offset(s) >= bucketFloats || !s) {
+            buckets.push(std::pair(offset(s), pendingEnd));
+            pendingEnd = offset(s);
+            ++bucketCount;
+        }
+    });
+
+    // every bucket is waited for, so that the next step does not take the results of this one
+    auto const backwardEnd = Clock_t::now();
+    std::exception_ptr failure;
+    for (Size_t b = 0; b < bucketCount; ++b) {
+        auto const [seconds, error] = reduced.pop();
+        totals.communicationSeconds += seconds;
+        if (error && !failure)
+            failure = error;
+    }
+    totals.exposedSeconds += secondsSince(backwardEnd);
+    if (failure)
+        std::rethrow_exception(failure);
+
+    Real_t samples = Real_t(gradient.samples);
+    ring.allreduce(&samples, 1);
+    gradient.samples = Size_t(samples);
+    network.applyGradient(gradient);
+    totals.stepSeconds += secondsSince(start);
+}
+
+void DataParallelTrainer::run()
+{
+    // once a peer is gone the ring stays broken, the later buckets get the same error
+    std::exception_ptr failure;
+    while (auto range = buckets.pop()) {
+        auto const start = Clock_t::now();
+        if (!failure)
+            try {
+                ring.allreduce(gradient.data() + range->first, range->second - range->first);
+            }
+            catch (std::runtime_error const&) {
+                failure = std::current_exception();
+            }
+        reduced.push({ secondsSince(start), failure });
+    }
+}
@@ -0,0 +1,234 @@
+#include <ExecutionPlan.hpp>
+#include <algorithm>
+#include <blaze/util/ThreadPool.h>
+#include <chrono>
+#include <condition_variable>
+#include <fstream>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+
+namespace {
+
+using ThreadPool_t = blaze::ThreadPool<std::thread, std::mutex, std::unique_lock<std::mutex>, std::condition_variable>;
+
+Size_t hardwareThreads() { return std::max(1u, std::thread::hardware_concurrency()); }
+
+// wait() waits for every task of the pool, so the threaded layers take turns on it
+ThreadPool_t& sharedPool(std::unique_lock<std::mutex>& lock)
+{
+    static ThreadPool_t pool(hardwareThreads());
+    static std::mutex mutex;
+    lock = std::unique_lock<std::mutex>(mutex);
+    return pool;
+}
+
+char const* strategyNames[] = { "rowwise", "gemm", "threaded" };
+
+template <typename MT>
+void activate(Layer const& layer, MT&& outputs)
+{
+    if (layer.activFn)
+        outputs = blaze::map(outputs, [&layer](Real_t z) { return layer.activFn(z); });
+}
+
+// rows [begin, end) of the batch, all of its columns
+void evalRows(Layer const& layer, Layer::Batch_t const& inputs, Layer::Batch_t& outputs, Size_t begin, Size_t end)
+{
+    auto out = blaze::submatrix(outputs, begin, 0, end - begin, outputs.columns());
+    out = blaze::serial(blaze::submatrix(inputs, begin, 0, end - begin, inputs.columns()) * layer.weights);
+    out += blaze::expand(layer.biases, end - begin);
+    activate(layer, out);
+}
+
+// columns [begin, end) of every row of the batch
+void evalColumns(Layer const& layer, Layer::Batch_t const& inputs, Layer::Batch_t& outputs, Size_t begin, Size_t end)
+{
+    auto out = blaze::submatrix(outputs, 0, begin, outputs.rows(), end - begin);
+    out = blaze::serial(inputs * blaze::submatrix(layer.weights, 0, begin, layer.weights.rows(), end - begin));
+    out += blaze::expand(blaze::subvector(layer.biases, begin, end - begin), outputs.rows());
+    activate(layer, out);
+}
+
+} // namespace
+
+void ExecutionPlan::set(Size_t inputs, Size_t outputs, Size_t batchSize, ExecutionStrategy strategy)
+{
+    entries[{ inputs, outputs, batchSize }] = strategy;
+}
+
+ExecutionStrategy ExecutionPlan::find(Size_t inputs, Size_t outputs, Size_t batchSize) const
+{
+    auto it = entries.upper_bound({ inputs, outputs, batchSize });
+    if (it != entries.begin() && std::get<0>(std::prev(it)->first) == inputs && std::get<1>(std::prev(it)->first) == outputs)
+        return std::prev(it)->second;
+    if (it != entries.end() && std::get<0>(it->first) == inputs && std::get<1>(it->first) == outputs)
+        return it->second;
+    return {};
+}
+
+bool ExecutionPlan::contains(Size_t inputs, Size_t outputs, Size_t batchSize) const
+{
+    return entries.count({ inputs, outputs, batchSize });
+}
+
+void ExecutionPlan::save(std::string const& path) const
+{
+    std::ofstream file(path);
+    file << "backprop-plan 1 " << hardwareThreads() << '\n';
+    for (auto const& [shape, strategy] : entries)
+        file << std::get<0>(shape) << ' ' << std::get<1>(shape) << ' ' << std::get<2>(shape) << ' '
+             << strategyNames[strategy.kind] << ' ' << strategy.threads << '\n';
+    if (!file)
+        throw std::runtime_error("Could not write the execution plan to " + path);
+}
+
+std::optional<ExecutionPlan> ExecutionPlan::load(std::string const& path)
+{
+    std::ifstream file(path);
+    std::string magic;
+    Size_t version = 0, threads = 0;
+    if (!(file >> magic >> version >> threads) || magic != "backprop-plan" || version != 1 || threads != hardwareThreads())
+        return std::nullopt;
+
+    ExecutionPlan plan;
+    Size_t inputs, outputs, batchSize;
+    std::string name;
+    ExecutionStrategy strategy;
+    while (file >> inputs >> outputs >> batchSize >> name >> strategy.threads) {
+        auto kind = std::find(std::begin(strategyNames), std::end(strategyNames), name);
+        if (kind == std::end(strategyNames) || !strategy.threads)
+            return std::nullopt;
+        strategy.kind = ExecutionStrategy::Kind(kind - std::begin(strategyNames));
+        plan.set(inputs, outputs, batchSize, strategy);
+    }
+    if (!file.eof())
+        return std::nullopt;
+    return plan;
+}
+
+ExecutionStrategy ExecutionPlan::measure(Size_t inputs, Size_t outputs, Size_t batchSize, Size_t maxThreads)
+{
+    Layer layer(inputs, outputs);
+    layer.setActivFn<SigmoidActivFn>();
+    Layer::Batch_t batch(batchSize, inputs), result;
+    batch = blaze::map(batch, [](Real_t) { return blaze::rand<Real_t>() * 2 - 1; });
+
+    std::vector<ExecutionStrategy> candidates = { { ExecutionStrategy::RowWise, 1 }, { ExecutionStrategy::Gemm, 1 } };
+    for (Size_t threads = 2; threads <= std::min(maxThreads, hardwareThreads()); threads *= 2)
+        candidates.push_back({ ExecutionStrategy::Threaded, threads });
+
+    // the best of a few rounds, each one long enough to be above the clock resolution
+    using Clock_t = std::chrono::steady_clock;
+    auto const seconds = [&](ExecutionStrategy strategy) {
+        auto const start = Clock_t::now();
+        run(layer, strategy, batch, result);
+        double const once = std::chrono::duration<double>(Clock_t::now() - start).count();
+        Size_t const repeats = Size_t(1e-3 / std::max(once, 1e-9)) + 1;
+
+        double best = once;
+        for (Size_t round = 0; round < 5; ++round) {
+            auto const roundStart = Clock_t::now();
+            for (Size_t r = 0; r < repeats; ++r)
+                run(layer, strategy, batch, result);
+            best = std::min(best, std::chrono::duration<double>(Clock_t::now() - roundStart).count() / repeats);
+        }
+        return best;
+    };
+
+    ExecutionStrategy fastest = candidates.front();
+    double fastestSeconds = seconds(fastest);
+    for (Size_t i = 1; i < candidates.size(); ++i)
+        if (double const s = seconds(candidates[i]); s < fastestSeconds) {
+            fastest = candidates[i];
+            fastestSeconds = s;
+        }
+    return fastest;
+}
+
+void ExecutionPlan::run(Layer const& layer, ExecutionStrategy strategy, Layer::Batch_t const& inputs, Layer::Batch_t& outputs)
+{
+    Size_t const rows = inputs.rows();
+    Size_t const columns = layer.weights.columns();
+    outputs.resize(rows, columns, false);
+
+    switch (strategy.kind) {
+    case ExecutionStrategy::RowWise:
+        for (Size_t i = 0; i < rows; ++i)
+            blaze::row(outputs, i) = blaze::serial(blaze::row(inputs, i) * layer.weights) + layer.biases;
+        activate(layer, outputs);
+        break;
+    case ExecutionStrategy::Gemm:
+        layer.infer(inputs, outputs);
+        break;
+    case ExecutionStrategy::Threaded: {
+        // whole SIMD packs of columns keep the threads off each other's cache lines
+        Size_t const pack = blaze::SIMDTrait_t<Real_t>::size;
+        bool const byRows = rows >= strategy.threads;
+        Size_t const extent = byRows ? rows : columns;
+        Size_t const align = byRows ? 1 : pack;
+        Size_t const width = (extent + strategy.threads * align - 1) / (strategy.threads * align) * align;
+
+        std::unique_lock<std::mutex> lock;
+        ThreadPool_t& pool = sharedPool(lock);
+        for (Size_t begin = 0; begin < extent; begin += width) {
+            Size_t const end = std::min(extent, begin + width);
+            if (byRows)
+                pool.schedule([&, begin, end] { evalRows(layer, inputs, outputs, begin, end); });
+            else
+                pool.schedule([&, begin, end] { evalColumns(layer, inputs, outputs, begin, end); });
+        }
+        pool.wait();
+        break;
+    }
+    }
+}
+
+ExecutionPlan const& DenseNN::tune(std::vector<Size_t> const& batchSizes, std::string const& path, Size_t maxThreads)
+{
+    if (!maxThreads)
+        maxThreads = hardwareThreads();
+
+    auto const covers = [&](ExecutionPlan const& plan) {
+        for (auto const& layer : layers)
+            for (Size_t batchSize : batchSizes)
+                if (!plan.contains(layer.weights.rows(), layer.weights.columns(), batchSize))
+                    return false;
+        return true;
+    };
+
+    std::optional<ExecutionPlan> plan = path.empty() ? std::nullopt : ExecutionPlan::load(path);
+    if (!plan || !covers(*plan)) {
+        if (!plan)
+            plan.emplace();
+        for (auto const& layer : layers)
+            for (Size_t batchSize : batchSizes)
+                if (!plan->contains(layer.weights.rows(), layer.weights.columns(), batchSize))
+                    plan->set(layer.weights.rows(), layer.weights.columns(), batchSize,
+                              ExecutionPlan::measure(layer.weights.rows(), layer.weights.columns(), batchSize, maxThreads));
+        if (!path.empty())
+            plan->save(path);
+    }
+
+    executionPlan = std::make_shared<ExecutionPlan const>(std::move(*plan));
+    return *executionPlan;
+}
+
+DenseNN& DenseNN::setExecutionPlan(ExecutionPlan plan)
+{
+    executionPlan = std::make_shared<ExecutionPlan const>(std::move(plan));
+    return *this;
+}
+
+Layer::Batch_t DenseNN::forwardPlanned(Layer::Batch_t const& inputs) const
+{
+    if (layers.empty())
+        throw std::logic_error("Network has no layers");
+    Layer::Batch_t buffers[2];
+    for (Size_t s = 0; s < layers.size(); ++s) {
+        Layer const& layer = layers[s];
+        ExecutionStrategy const strategy = executionPlan->find(layer.weights.rows(), layer.weights.columns(), inputs.rows());
+        ExecutionPlan::run(layer, strategy, s ? buffers[(s - 1) % 2] : inputs, buffers[s % 2]);
+    }
+    return std::move(buffers[(layers.size() - 1) % 2]);
+}
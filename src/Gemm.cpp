@@ -0,0 +1,382 @@
+#include <Gemm.hpp>
+#include <algorithm>
+#include <stdexcept>
+#include <vector>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define BACKPROP_SIMD_KERNELS 1
+#include <immintrin.h>
+#endif
+
+#ifdef BACKPROP_USE_CBLAS
+#include <cblas.h>
+#endif
+
+namespace {
+
+template <typename A_t, typename B_t, typename C_t>
+void blazeGemm(A_t const& A, B_t const& B, C_t& C, Real_t beta)
+{
+    if (beta == 0)
+        C = A * B;
+    else if (beta == 1)
+        C += A * B;
+    else {
+        C *= beta;
+        C += A * B;
+    }
+}
+
+// bias + x * panels for panelCount panels of k rows, y gets panelCount whole panel widths
+using GemvKernel_t = void (*)(Size_t k, Size_t panelCount, Real_t const* panels, Real_t const* bias, Real_t const* x, Real_t* y);
+
+struct GemvKernel {
+    Size_t width;
+    GemvKernel_t multiply;
+};
+
+// out[i] = dot(row i of a, x) for m rows of n elements, times scale(z[i]) when scale is given
+using RowDotsKernel_t = void (*)(Size_t m, Size_t n, Real_t const* a, Size_t lda, Real_t const* x, Real_t* out, RowScaleFn_t scale,
+                                 Real_t const* z);
+
+constexpr Size_t PrefetchRows = 8; // distance of the prefetches of the gemv panels
+
+#ifdef BACKPROP_SIMD_KERNELS
+
+__attribute__((target("avx512f,fma"))) void gemvAvx512(Size_t k, Size_t panelCount, Real_t const* panels, Real_t const* bias,
+                                                        Real_t const* x, Real_t* y)
+{
+    constexpr Size_t W = 64;
+    for (Size_t c = 0; c < panelCount; ++c, bias += W, y += W) {
+        // even and odd rows go to separate accumulators, which halves the chains of dependent fmas
+        __m512 even[4], odd[4];
+#pragma GCC unroll 4
+        for (Size_t v = 0; v < 4; ++v) {
+            even[v] = _mm512_load_ps(bias + 16 * v);
+            odd[v] = _mm512_setzero_ps();
+        }
+
+        Size_t i = 0;
+        for (; i + 2 <= k; i += 2, panels += 2 * W) {
+#pragma GCC unroll 8
+            for (Size_t line = 0; line < 2 * W; line += 16)
+                _mm_prefetch(reinterpret_cast<char const*>(panels + PrefetchRows * W + line), _MM_HINT_T0);
+            __m512 const x0 = _mm512_set1_ps(x[i]);
+            __m512 const x1 = _mm512_set1_ps(x[i + 1]);
+#pragma GCC unroll 4
+            for (Size_t v = 0; v < 4; ++v) {
+                even[v] = _mm512_fmadd_ps(x0, _mm512_load_ps(panels + 16 * v), even[v]);
+                odd[v] = _mm512_fmadd_ps(x1, _mm512_load_ps(panels + W + 16 * v), odd[v]);
+            }
+        }
+        if (i < k) {
+            __m512 const x0 = _mm512_set1_ps(x[i]);
+#pragma GCC unroll 4
+            for (Size_t v = 0; v < 4; ++v)
+                even[v] = _mm512_fmadd_ps(x0, _mm512_load_ps(panels + 16 * v), even[v]);
+            panels += W;
+        }
+#pragma GCC unroll 4
+        for (Size_t v = 0; v < 4; ++v)
+            _mm512_storeu_ps(y + 16 * v, _mm512_add_ps(even[v], odd[v]));
+    }
+}
+
+__attribute__((target("avx2,fma"))) void gemvAvx2(Size_t k, Size_t panelCount, Real_t const* panels, Real_t const* bias,
+                                                  Real_t const* x, Real_t* y)
+{
+    constexpr Size_t W = 32;
+    for (Size_t c = 0; c < panelCount; ++c, bias += W, y += W) {
+        __m256 even[4], odd[4];
+#pragma GCC unroll 4
+        for (Size_t v = 0; v < 4; ++v) {
+            even[v] = _mm256_load_ps(bias + 8 * v);
+            odd[v] = _mm256_setzero_ps();
+        }
+
+        Size_t i = 0;
+        for (; i + 2 <= k; i += 2, panels += 2 * W) {
+#pragma GCC unroll 4
+            for (Size_t line = 0; line < 2 * W; line += 16)
+                _mm_prefetch(reinterpret_cast<char const*>(panels + PrefetchRows * W + line), _MM_HINT_T0);
+            __m256 const x0 = _mm256_set1_ps(x[i]);
+            __m256 const x1 = _mm256_set1_ps(x[i + 1]);
+#pragma GCC unroll 4
+            for (Size_t v = 0; v < 4; ++v) {
+                even[v] = _mm256_fmadd_ps(x0, _mm256_load_ps(panels + 8 * v), even[v]);
+                odd[v] = _mm256_fmadd_ps(x1, _mm256_load_ps(panels + W + 8 * v), odd[v]);
+            }
+        }
+        if (i < k) {
+            __m256 const x0 = _mm256_set1_ps(x[i]);
+#pragma GCC unroll 4
+            for (Size_t v = 0; v < 4; ++v)
+                even[v] = _mm256_fmadd_ps(x0, _mm256_load_ps(panels + 8 * v), even[v]);
+            panels += W;
+        }
+#pragma GCC unroll 4
+        for (Size_t v = 0; v < 4; ++v)
+            _mm256_storeu_ps(y + 8 * v, _mm256_add_ps(even[v], odd[v]));
+    }
+}
+
+__attribute__((target("avx2,fma"))) inline Real_t horizontalSum(__m256 v)
+{
+    __m128 const half = _mm_add_ps(_mm256_castps256_ps128(v), _mm256_extractf128_ps(v, 1));
+    __m128 const quarter = _mm_add_ps(half, _mm_movehl_ps(half, half));
+    return _mm_cvtss_f32(_mm_add_ss(quarter, _mm_movehdup_ps(quarter)));
+}
+
+// through memory: the 512-bit shuffles and casts trip -Wuninitialized inside GCC's headers
+__attribute__((target("avx512f,fma"))) inline Real_t horizontalSum(__m512 v)
+{
+    alignas(64) Real_t lanes[16];
+    _mm512_store_ps(lanes, v);
+    return horizontalSum(_mm256_add_ps(_mm256_load_ps(lanes), _mm256_load_ps(lanes + 8)));
+}
+
+// R rows at a time share every load of x; two accumulators per row halve the chains of fmas
+template <Size_t R>
+__attribute__((target("avx512f,fma"))) inline void dotRowsAvx512(Size_t n, Real_t const* a, Size_t lda, Real_t const* x, Real_t* out)
+{
+    __m512 even[R], odd[R];
+#pragma GCC unroll 4
+    for (Size_t r = 0; r < R; ++r)
+        even[r] = odd[r] = _mm512_setzero_ps();
+
+    Size_t j = 0;
+    for (; j + 32 <= n; j += 32) {
+        __m512 const x0 = _mm512_loadu_ps(x + j);
+        __m512 const x1 = _mm512_loadu_ps(x + j + 16);
+#pragma GCC unroll 4
+        for (Size_t r = 0; r < R; ++r) {
+            even[r] = _mm512_fmadd_ps(_mm512_loadu_ps(a + r * lda + j), x0, even[r]);
+            odd[r] = _mm512_fmadd_ps(_mm512_loadu_ps(a + r * lda + j + 16), x1, odd[r]);
+        }
+    }
+    for (; j < n; j += 16) {
+        __mmask16 const mask = n - j >= 16 ? __mmask16(0xffff) : __mmask16((1u << (n - j)) - 1);
+        __m512 const x0 = _mm512_maskz_loadu_ps(mask, x + j);
+#pragma GCC unroll 4
+        for (Size_t r = 0; r < R; ++r)
+            even[r] = _mm512_fmadd_ps(_mm512_maskz_loadu_ps(mask, a + r * lda + j), x0, even[r]);
+    }
+#pragma GCC unroll 4
+    for (Size_t r = 0; r < R; ++r)
+        out[r] = horizontalSum(_mm512_add_ps(even[r], odd[r]));
+}
+
+__attribute__((target("avx512f,fma"))) void rowDotsAvx512(Size_t m, Size_t n, Real_t const* a, Size_t lda, Real_t const* x, Real_t* out,
+                                                           RowScaleFn_t scale, Real_t const* z)
+{
+    for (Size_t i = 0; i < m; i += 4) {
+        Size_t const end = std::min(m, i + 4);
+        if (end - i == 4)
+            dotRowsAvx512<4>(n, a + i * lda, lda, x, out + i);
+        else
+            for (Size_t r = i; r < end; ++r)
+                dotRowsAvx512<1>(n, a + r * lda, lda, x, out + r);
+        if (scale)
+            for (Size_t r = i; r < end; ++r)
+                out[r] *= scale(z[r]);
+    }
+}
+
+template <Size_t R>
+__attribute__((target("avx2,fma"))) inline void dotRowsAvx2(Size_t n, Real_t const* a, Size_t lda, Real_t const* x, Real_t* out)
+{
+    __m256 even[R], odd[R];
+#pragma GCC unroll 4
+    for (Size_t r = 0; r < R; ++r)
+        even[r] = odd[r] = _mm256_setzero_ps();
+
+    Size_t j = 0;
+    for (; j + 16 <= n; j += 16) {
+        __m256 const x0 = _mm256_loadu_ps(x + j);
+        __m256 const x1 = _mm256_loadu_ps(x + j + 8);
+#pragma GCC unroll 4
+        for (Size_t r = 0; r < R; ++r) {
+            even[r] = _mm256_fmadd_ps(_mm256_loadu_ps(a + r * lda + j), x0, even[r]);
+            odd[r] = _mm256_fmadd_ps(_mm256_loadu_ps(a + r * lda + j + 8), x1, odd[r]);
+        }
+    }
+#pragma GCC unroll 4
+    for (Size_t r = 0; r < R; ++r) {
+        Real_t sum = horizontalSum(_mm256_add_ps(even[r], odd[r]));
+        for (Size_t k = j; k < n; ++k)
+            sum += a[r * lda + k] * x[k];
+        out[r] = sum;
+    }
+}
+
+__attribute__((target("avx2,fma"))) void rowDotsAvx2(Size_t m, Size_t n, Real_t const* a, Size_t lda, Real_t const* x, Real_t* out,
+                                                     RowScaleFn_t scale, Real_t const* z)
+{
+    for (Size_t i = 0; i < m; i += 4) {
+        Size_t const end = std::min(m, i + 4);
+        if (end - i == 4)
+            dotRowsAvx2<4>(n, a + i * lda, lda, x, out + i);
+        else
+            for (Size_t r = i; r < end; ++r)
+                dotRowsAvx2<1>(n, a + r * lda, lda, x, out + r);
+        if (scale)
+            for (Size_t r = i; r < end; ++r)
+                out[r] *= scale(z[r]);
+    }
+}
+
+#endif
+
+void gemvGeneric(Size_t k, Size_t panelCount, Real_t const* panels, Real_t const* bias, Real_t const* x, Real_t* y)
+{
+    constexpr Size_t W = 16;
+    for (Size_t c = 0; c < panelCount; ++c, bias += W, y += W) {
+        std::copy(bias, bias + W, y);
+        for (Size_t i = 0; i < k; ++i, panels += W)
+            for (Size_t j = 0; j < W; ++j)
+                y[j] += x[i] * panels[j];
+    }
+}
+
+GemvKernel detectGemvKernel()
+{
+#ifdef BACKPROP_SIMD_KERNELS
+    if (__builtin_cpu_supports("avx512f"))
+        return { 64, gemvAvx512 };
+    if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma"))
+        return { 32, gemvAvx2 };
+#endif
+    return { 16, gemvGeneric };
+}
+
+GemvKernel const& gemvKernel()
+{
+    static GemvKernel const kernel = detectGemvKernel();
+    return kernel;
+}
+
+void rowDotsGeneric(Size_t m, Size_t n, Real_t const* a, Size_t lda, Real_t const* x, Real_t* out, RowScaleFn_t scale, Real_t const* z)
+{
+    for (Size_t i = 0; i < m; ++i, a += lda) {
+        Real_t sum = 0;
+        for (Size_t j = 0; j < n; ++j)
+            sum += a[j] * x[j];
+        out[i] = scale ? sum * scale(z[i]) : sum;
+    }
+}
+
+RowDotsKernel_t detectRowDotsKernel()
+{
+#ifdef BACKPROP_SIMD_KERNELS
+    if (__builtin_cpu_supports("avx512f"))
+        return rowDotsAvx512;
+    if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma"))
+        return rowDotsAvx2;
+#endif
+    return rowDotsGeneric;
+}
+
+// aligned memory for at least size elements, the buffer only grows
+Real_t* scratch(std::vector<CacheLine_t>& buffer, Size_t size)
+{
+    Size_t constexpr perLine = 64 / sizeof(Real_t);
+    if (buffer.empty() || buffer.size() * perLine < size)
+        buffer.resize(std::max<Size_t>(1, (size + perLine - 1) / perLine));
+    return buffer.front().values;
+}
+
+} // namespace
+
+bool cblasAvailable()
+{
+#ifdef BACKPROP_USE_CBLAS
+    return true;
+#else
+    return false;
+#endif
+}
+
+template <typename A_t, typename B_t, typename C_t>
+void gemm(A_t const& A, bool transposeA, B_t const& B, bool transposeB, C_t& C, Real_t beta, GemmBackend backend)
+{
+    Size_t const m = transposeA ? A.columns() : A.rows();
+    Size_t const k = transposeA ? A.rows() : A.columns();
+    Size_t const n = transposeB ? B.rows() : B.columns();
+    bool const resized = beta == 0 && blaze::IsResizable_v<C_t>;
+    if (k != (transposeB ? B.columns() : B.rows()) || (!resized && (C.rows() != m || C.columns() != n)))
+        throw std::logic_error("Matrix sizes do not match");
+
+    if (backend == GemmBackend::Cblas && !cblasAvailable())
+        throw std::logic_error("The project was built without the blas option");
+    if (backend == GemmBackend::Auto)
+        backend = cblasAvailable() && m * n * k >= BACKPROP_CBLAS_CUTOFF ? GemmBackend::Cblas : GemmBackend::Blaze;
+
+#ifdef BACKPROP_USE_CBLAS
+    // empty products are left to Blaze, sgemm rejects zero leading dimensions
+    if (backend == GemmBackend::Cblas && m && n && k) {
+        // the padding of the rows stays zero, sgemm only writes the first n elements of every row
+        if constexpr (blaze::IsResizable_v<C_t>)
+            if (beta == 0)
+                C.resize(m, n, false);
+        cblas_sgemm(CblasRowMajor, transposeA ? CblasTrans : CblasNoTrans, transposeB ? CblasTrans : CblasNoTrans,
+                    m, n, k, 1, A.data(), A.spacing(), B.data(), B.spacing(), beta, C.data(), C.spacing());
+        return;
+    }
+#endif
+
+    if (transposeA && transposeB)
+        blazeGemm(blaze::trans(A), blaze::trans(B), C, beta);
+    else if (transposeA)
+        blazeGemm(blaze::trans(A), B, C, beta);
+    else if (transposeB)
+        blazeGemm(A, blaze::trans(B), C, beta);
+    else
+        blazeGemm(A, B, C, beta);
+}
+
+template void gemm(Layer::Batch_t const&, bool, Layer::Batch_t const&, bool, Layer::Batch_t&, Real_t, GemmBackend);
+template void gemm(Layer::Batch_t const&, bool, Layer::Batch_t const&, bool, Layer::Weights_t&, Real_t, GemmBackend);
+template void gemm(Layer::Batch_t const&, bool, Layer::Weights_t const&, bool, Layer::Batch_t&, Real_t, GemmBackend);
+template void gemm(Layer::Batch_t const&, bool, Layer::Weights_t const&, bool, Layer::Weights_t&, Real_t, GemmBackend);
+template void gemm(BatchRows_t const&, bool, Layer::Weights_t const&, bool, Layer::Batch_t&, Real_t, GemmBackend);
+template void gemm(Layer::Weights_t const&, bool, Layer::Batch_t const&, bool, Layer::Batch_t&, Real_t, GemmBackend);
+template void gemm(Layer::Weights_t const&, bool, Layer::Batch_t const&, bool, Layer::Weights_t&, Real_t, GemmBackend);
+template void gemm(Layer::Weights_t const&, bool, Layer::Weights_t const&, bool, Layer::Batch_t&, Real_t, GemmBackend);
+template void gemm(Layer::Weights_t const&, bool, Layer::Weights_t const&, bool, Layer::Weights_t&, Real_t, GemmBackend);
+
+PackedGemv::PackedGemv(Layer::Weights_t const& weights, Layer::Biases_t const& biases)
+    : k(weights.rows()),
+      n(weights.columns())
+{
+    if (biases.size() != n)
+        throw std::logic_error("Biases do not match the weights");
+
+    Size_t const W = panelWidth();
+    Real_t* const packed = scratch(panels, paddedColumns() * k);
+    Real_t* const bias = scratch(this->biases, paddedColumns());
+    for (Size_t c = 0; c * W < n; ++c) {
+        Size_t const width = std::min(W, n - c * W);
+        for (Size_t i = 0; i < k; ++i) {
+            Real_t* const row = packed + (c * k + i) * W;
+            std::copy(weights.data(i) + c * W, weights.data(i) + c * W + width, row);
+            std::fill(row + width, row + W, Real_t(0));
+        }
+        std::copy(biases.data() + c * W, biases.data() + c * W + width, bias + c * W);
+        std::fill(bias + c * W + width, bias + (c + 1) * W, Real_t(0));
+    }
+}
+
+void PackedGemv::multiply(Real_t const* input, Real_t* output) const
+{
+    gemvKernel().multiply(k, paddedColumns() / panelWidth(), panels.front().values, biases.front().values, input, output);
+}
+
+void rowDots(Layer::Weights_t const& A, Real_t const* x, Real_t* out, RowScaleFn_t scale, Real_t const* z)
+{
+    static RowDotsKernel_t const kernel = detectRowDotsKernel();
+    kernel(A.rows(), A.columns(), A.data(), A.spacing(), x, out, scale, z);
+}
+
+Size_t PackedGemv::paddedColumns() const { return (n + panelWidth() - 1) / panelWidth() * panelWidth(); }
+
+Size_t PackedGemv::panelWidth() { return gemvKernel().width; }
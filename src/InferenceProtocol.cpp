@@ -0,0 +1,130 @@
+#include <InferenceProtocol.hpp>
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+namespace {
+
+constexpr std::uint32_t MaxValues = 1 << 24;
+
+// header and values in one send when possible
+bool writeFrame(int fd, void const* header, Size_t headerBytes, Real_t const* values, Size_t count)
+{
+    iovec parts[2] = { { const_cast<void*>(header), headerBytes }, { const_cast<Real_t*>(values), count * sizeof(Real_t) } };
+    msghdr message{};
+    message.msg_iov = parts;
+    message.msg_iovlen = count ? 2 : 1;
+    while (message.msg_iovlen) {
+        ssize_t sent = ::sendmsg(fd, &message, MSG_NOSIGNAL);
+        if (sent < 0 && errno == EINTR)
+            continue;
+        if (sent <= 0)
+            return false;
+        while (message.msg_iovlen && Size_t(sent) >= message.msg_iov->iov_len) {
+            sent -= message.msg_iov->iov_len;
+            ++message.msg_iov;
+            --message.msg_iovlen;
+        }
+        if (message.msg_iovlen) {
+            message.msg_iov->iov_base = static_cast<char*>(message.msg_iov->iov_base) + sent;
+            message.msg_iov->iov_len -= sent;
+        }
+    }
+    return true;
+}
+
+template <typename Header_t>
+bool readFrame(int fd, std::uint32_t magic, Header_t& header, std::vector<Real_t>& values)
+{
+    if (!protocol::readAll(fd, &header, sizeof(header)) || header.magic != magic || header.size > MaxValues)
+        return false;
+    values.resize(header.size);
+    return protocol::readAll(fd, values.data(), header.size * sizeof(Real_t));
+}
+
+sockaddr_un unixAddress(std::string const& path)
+{
+    sockaddr_un address{};
+    address.sun_family = AF_UNIX;
+    if (path.size() >= sizeof(address.sun_path))
+        throw std::runtime_error("Socket path is too long: " + path);
+    std::strcpy(address.sun_path, path.c_str());
+    return address;
+}
+
+} // namespace
+
+namespace protocol {
+
+bool readAll(int fd, void* data, Size_t bytes)
+{
+    auto* bytePtr = static_cast<char*>(data);
+    while (bytes) {
+        ssize_t const got = ::read(fd, bytePtr, bytes);
+        if (got < 0 && errno == EINTR)
+            continue;
+        if (got <= 0)
+            return false;
+        bytePtr += got;
+        bytes -= got;
+    }
+    return true;
+}
+
+bool writeAll(int fd, void const* data, Size_t bytes)
+{
+    auto const* bytePtr = static_cast<char const*>(data);
+    while (bytes) {
+        ssize_t const sent = ::send(fd, bytePtr, bytes, MSG_NOSIGNAL);
+        if (sent < 0 && errno == EINTR)
+            continue;
+        if (sent <= 0)
+            return false;
+        bytePtr += sent;
+        bytes -= sent;
+    }
+    return true;
+}
+
+bool readRequest(int fd, RequestHeader& header, std::vector<Real_t>& values) { return readFrame(fd, RequestMagic, header, values); }
+
+bool readResponse(int fd, ResponseHeader& header, std::vector<Real_t>& values) { return readFrame(fd, ResponseMagic, header, values); }
+
+bool writeRequest(int fd, RequestHeader const& header, Real_t const* values) { return writeFrame(fd, &header, sizeof(header), values, header.size); }
+
+bool writeResponse(int fd, ResponseHeader const& header, Real_t const* values) { return writeFrame(fd, &header, sizeof(header), values, header.size); }
+
+int listenUnix(std::string const& path)
+{
+    sockaddr_un const address = unixAddress(path);
+    int const fd = ::socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0)
+        throw std::runtime_error(std::string("socket: ") + std::strerror(errno));
+    ::unlink(path.c_str());
+    if (::bind(fd, reinterpret_cast<sockaddr const*>(&address), sizeof(address)) || ::listen(fd, SOMAXCONN)) {
+        int const error = errno;
+        ::close(fd);
+        throw std::runtime_error("Could not listen on " + path + ": " + std::strerror(error));
+    }
+    return fd;
+}
+
+int connectUnix(std::string const& path)
+{
+    sockaddr_un const address = unixAddress(path);
+    int const fd = ::socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0)
+        throw std::runtime_error(std::string("socket: ") + std::strerror(errno));
+    if (::connect(fd, reinterpret_cast<sockaddr const*>(&address), sizeof(address))) {
+        int const error = errno;
+        ::close(fd);
+        throw std::runtime_error("Could not connect to " + path + ": " + std::strerror(error));
+    }
+    return fd;
+}
+
+} // namespace protocol
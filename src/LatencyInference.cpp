@@ -0,0 +1,43 @@
+#include <LatencyInference.hpp>
+#include <algorithm>
+
+LatencyInference::LatencyInference(DenseNN const& network)
+{
+    Size_t widest = 0;
+    for (auto const& layer : network.getLayers()) {
+        stages.push_back(Stage{ PackedGemv(layer.weights, layer.biases), layer.activFn });
+        widest = std::max(widest, stages.back().weights.paddedColumns());
+    }
+    if (stages.empty())
+        throw std::logic_error("Network has no layers");
+
+    buffers[0].resize(widest);
+    buffers[1].resize(widest);
+}
+
+Layer::Vec_t LatencyInference::operator()(Layer::Vec_t const& input)
+{
+    Layer::Vec_t output;
+    eval(input, output);
+    return output;
+}
+
+void LatencyInference::eval(Layer::Vec_t const& input, Layer::Vec_t& output)
+{
+    if (input.size() != stages.front().weights.rows())
+        throw std::logic_error("Input size does not match the first layer");
+
+    Real_t const* in = input.data();
+    for (Size_t s = 0; s < stages.size(); ++s) {
+        Stage const& stage = stages[s];
+        Real_t* const out = buffers[s % 2].data();
+        stage.weights.multiply(in, out);
+        if (stage.activFn)
+            std::transform(out, out + stage.weights.columns(), out, stage.activFn);
+        in = out;
+    }
+
+    Size_t const size = stages.back().weights.columns();
+    output.resize(size, false);
+    std::copy(in, in + size, output.data());
+}
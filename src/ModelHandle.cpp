@@ -0,0 +1,45 @@
+#include <ModelHandle.hpp>
+#include <algorithm>
+#include <thread>
+
+ModelHandle::ModelHandle(DenseNN network)
+    : current(new DenseNN(std::move(network))),
+      stripes(2 * std::max(1u, std::thread::hardware_concurrency()))
+{
+}
+
+ModelHandle::~ModelHandle() { delete current.load(); }
+
+Size_t ModelHandle::stripeIndex()
+{
+    static std::atomic<Size_t> threads{ 0 };
+    thread_local Size_t const index = threads.fetch_add(1, std::memory_order_relaxed);
+    return index;
+}
+
+void ModelHandle::waitForReaders(Size_t parity) const
+{
+    for (auto const& stripe : stripes)
+        for (Size_t spins = 0; stripe.readers[parity].load(std::memory_order_seq_cst); ++spins)
+            if (spins > 64)
+                std::this_thread::yield();
+}
+
+void ModelHandle::swap(DenseNN network)
+{
+    auto const* const replacement = new DenseNN(std::move(network));
+    std::lock_guard<std::mutex> lock(swapping);
+    DenseNN const* const old = current.exchange(replacement, std::memory_order_seq_cst);
+
+    // Readers of the old model count themselves in either parity: in the current one, or in the
+    // other one if they read the parity before the last swap flipped it and counted themselves
+    // after its grace period. Flipping twice and draining the parity left behind each time
+    // waits for both, while new readers keep entering the parity that is not being drained.
+    for (Size_t flip = 0; flip < 2; ++flip) {
+        Size_t const drained = parity.load(std::memory_order_relaxed);
+        parity.store(drained ^ 1, std::memory_order_seq_cst);
+        waitForReaders(drained);
+    }
+    swaps.fetch_add(1, std::memory_order_relaxed);
+    delete old;
+}
@@ -0,0 +1,158 @@
+#include <Concurrency.hpp>
+#include <ModelParallel.hpp>
+#include <algorithm>
+#include <stdexcept>
+
+ShardedLayer::ShardedLayer(Layer const& layer, Size_t threads, Size_t firstCpu)
+    : source(&layer),
+      rows(layer.weights.rows()),
+      columns(layer.weights.columns()),
+      activFn(layer.activFn),
+      shards(std::max<Size_t>(1, std::min(threads, columns)))
+{
+    // slices of whole SIMD packs keep every shard's stores aligned and apart from the others
+    Size_t const pack = blaze::SIMDTrait_t<Real_t>::size;
+    Size_t const width = (columns + shards.size() * pack - 1) / (shards.size() * pack) * pack;
+    for (Size_t i = 0; i < shards.size(); ++i) {
+        shards[i].begin = std::min(columns, i * width);
+        shards[i].end = std::min(columns, (i + 1) * width);
+    }
+
+    // the shards copy their slice before taking jobs, wait until all of them are done
+    for (Size_t i = 0; i < shards.size(); ++i)
+        shards[i].thread = std::thread(&ShardedLayer::run, this, i, firstCpu + i);
+    std::unique_lock<std::mutex> lock(mutex);
+    finished.wait(lock, [this] { return completed == shards.size(); });
+    source = nullptr;
+}
+
+ShardedLayer::~ShardedLayer()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    started.notify_all();
+    for (auto& shard : shards)
+        shard.thread.join();
+}
+
+void ShardedLayer::run(Size_t index, Size_t cpu)
+{
+    pinCurrentThread(cpu);
+    Shard& shard = shards[index];
+    Size_t const n = shard.end - shard.begin;
+    shard.weights = blaze::submatrix(source->weights, 0, shard.begin, source->weights.rows(), n);
+    shard.biases = blaze::subvector(source->biases, shard.begin, n);
+
+    Size_t seen = 0;
+    for (;;) {
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            if (++completed == shards.size())
+                finished.notify_one();
+            started.wait(lock, [&] { return generation != seen || stopping; });
+            if (stopping)
+                return;
+            seen = generation;
+        }
+
+        if (!n)
+            continue;
+        if (vecInput) {
+            auto out = blaze::subvector(*vecOutput, shard.begin, n);
+            out = *vecInput * shard.weights + shard.biases;
+            if (activFn)
+                out = blaze::map(out, [this](Real_t z) { return activFn(z); });
+        }
+        else {
+            auto out = blaze::submatrix(*batchOutput, 0, shard.begin, batchInput->rows(), n);
+            out = *batchInput * shard.weights + blaze::expand(shard.biases, batchInput->rows());
+            if (activFn)
+                out = blaze::map(out, [this](Real_t z) { return activFn(z); });
+        }
+    }
+}
+
+void ShardedLayer::dispatch()
+{
+    std::unique_lock<std::mutex> lock(mutex);
+    completed = 0;
+    ++generation;
+    started.notify_all();
+    finished.wait(lock, [this] { return completed == shards.size(); });
+}
+
+void ShardedLayer::eval(Layer::Vec_t const& input, Layer::Vec_t& output)
+{
+    if (input.size() != rows)
+        throw std::logic_error("The input is not of the layer's size");
+    output.resize(columns, false);
+    vecInput = &input;
+    vecOutput = &output;
+    batchInput = nullptr;
+    batchOutput = nullptr;
+    dispatch();
+}
+
+void ShardedLayer::eval(Layer::Batch_t const& inputs, Layer::Batch_t& outputs)
+{
+    if (inputs.columns() != rows)
+        throw std::logic_error("The inputs are not of the layer's size");
+    outputs.resize(inputs.rows(), columns, false);
+    vecInput = nullptr;
+    vecOutput = nullptr;
+    batchInput = &inputs;
+    batchOutput = &outputs;
+    dispatch();
+}
+
+ModelParallelNN::ModelParallelNN(DenseNN const& network, Size_t threads, Size_t cacheBytes)
+{
+    auto const& source = network.getLayers();
+    if (source.empty())
+        throw std::logic_error("Network has no layers");
+    inputSize = source.front().weights.rows();
+    for (auto const& layer : source) {
+        bool const wide = layer.weights.rows() * layer.weights.columns() * sizeof(Real_t) > cacheBytes;
+        sharded.push_back(wide && threads > 1 ? std::make_unique<ShardedLayer>(layer, threads) : nullptr);
+        layers.push_back(sharded.back() ? std::nullopt : std::optional<Layer>(layer));
+    }
+}
+
+Layer::Vec_t ModelParallelNN::operator()(Layer::Vec_t const& input)
+{
+    if (input.size() != inputSize)
+        throw std::logic_error("Input size does not match the first layer");
+    Layer::Vec_t buffers[2] = { input, Layer::Vec_t() };
+    for (Size_t s = 0; s < layers.size(); ++s) {
+        auto const& in = buffers[s % 2];
+        auto& out = buffers[(s + 1) % 2];
+        if (sharded[s])
+            sharded[s]->eval(in, out);
+        else
+            out = layers[s]->eval(in).first;
+    }
+    return std::move(buffers[layers.size() % 2]);
+}
+
+Layer::Batch_t ModelParallelNN::operator()(Layer::Batch_t const& inputs)
+{
+    if (inputs.columns() != inputSize)
+        throw std::logic_error("The inputs are not of the first layer's size");
+    Layer::Batch_t buffers[2] = { inputs, Layer::Batch_t() };
+    for (Size_t s = 0; s < layers.size(); ++s) {
+        auto const& in = buffers[s % 2];
+        auto& out = buffers[(s + 1) % 2];
+        if (sharded[s])
+            sharded[s]->eval(in, out);
+        else
+            layers[s]->infer(in, out);
+    }
+    return std::move(buffers[layers.size() % 2]);
+}
+
+Size_t ModelParallelNN::shardedLayers() const
+{
+    return std::count_if(sharded.begin(), sharded.end(), [](auto const& layer) { return layer != nullptr; });
+}
@@ -1,29 +1,562 @@
+#include <Gemm.hpp>
 #include <NeuralNetwork.hpp>
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <exception>
+#include <fstream>
 #include <iostream>
+#include <sstream>
+#include <thread>
+
+namespace {
+
+void addOuter(Layer::Weights_t& gradient, std::vector<Size_t>&, Layer::Vec_t const& input, Layer::Vec_t const& delta)
+{
+    gradient += blaze::trans(input) * delta;
+}
+
+void addOuter(Layer::Weights_t& gradient, std::vector<Size_t>&, Layer::Batch_t const& inputs, Layer::Batch_t const& deltas)
+{
+    gemm(inputs, true, deltas, false, gradient, 1);
+}
+
+// only the rows of non-zero inputs are touched, they are recorded in rows
+void addOuter(Layer::Weights_t& gradient, std::vector<Size_t>& rows, Layer::SparseVec_t const& input, Layer::Vec_t const& delta)
+{
+    for (auto const& element : input) {
+        blaze::row(gradient, element.index()) += element.value() * delta;
+        rows.push_back(element.index());
+    }
+}
+
+void addOuter(Layer::Weights_t& gradient, std::vector<Size_t>& rows, Layer::SparseBatch_t const& inputs, Layer::Batch_t const& deltas)
+{
+    for (Size_t i = 0; i < inputs.rows(); ++i)
+        for (auto it = inputs.begin(i); it != inputs.end(i); ++it) {
+            blaze::row(gradient, it->index()) += it->value() * blaze::row(deltas, i);
+            rows.push_back(it->index());
+        }
+}
+
+void addBiasOuter(Layer::Biases_t& gradient, Layer::Vec_t const& delta) { gradient += delta; }
+
+// dE/df(z) of the previous layer
+Layer::Vec_t backPropagate(Layer::Vec_t const& delta, Layer::Weights_t const& weights) { return delta * blaze::trans(weights); }
+
+Layer::Batch_t backPropagate(Layer::Batch_t const& deltas, Layer::Weights_t const& weights)
+{
+    Layer::Batch_t result;
+    gemm(deltas, false, weights, true, result);
+    return result;
+}
+
+// dE/dz of the layer below from the delta of the layer above, without temporaries: one pass over
+// the weights of dots of their rows with the delta, each scaled by the derivative of the layer below
+void backPropagate(Layer::Vec_t const& delta, Layer const& above, Layer const& below, Layer::Vec_t const& z, Layer::Vec_t& result)
+{
+    result.resize(above.weights.rows(), false);
+    rowDots(above.weights, delta.data(), result.data(), below.activFnDeriv, z.data());
+}
+
+// the product of a batch, scaled in place
+void backPropagate(Layer::Batch_t const& deltas, Layer const& above, Layer const& below, Layer::Batch_t const& z, Layer::Batch_t& result)
+{
+    gemm(deltas, false, above.weights, true, result);
+    below.multiplyDerivZ(z, result);
+}
+
+void addBiasOuter(Layer::Biases_t& gradient, Layer::Batch_t const& deltas) { gradient += blaze::sum<blaze::columnwise>(deltas); }
+
+Size_t sampleCount(Layer::Vec_t const&) { return 1; }
+
+Size_t sampleCount(Layer::Batch_t const& batch) { return batch.rows(); }
+
+Real_t const* sampleData(Layer::Vec_t const& vec, Size_t) { return vec.data(); }
+
+Real_t const* sampleData(Layer::Batch_t const& batch, Size_t i) { return batch.data(i); }
+
+Real_t* sampleData(Layer::Vec_t& vec, Size_t) { return vec.data(); }
+
+Real_t* sampleData(Layer::Batch_t& batch, Size_t i) { return batch.data(i); }
+
+void resizeLike(Layer::Vec_t& vec, Layer::Vec_t const& like) { vec.resize(like.size(), false); }
+
+void resizeLike(Layer::Batch_t& batch, Layer::Batch_t const& like) { batch.resize(like.rows(), like.columns(), false); }
+
+template <typename MT>
+void inferBatch(Layer const& layer, MT const& inputs, Layer::Batch_t& outputs)
+{
+    if constexpr (blaze::IsDenseMatrix_v<MT>)
+        gemm(inputs, false, layer.weights, false, outputs);
+    else
+        outputs = inputs * layer.weights;
+    outputs += blaze::expand(layer.biases, outputs.rows());
+    if (layer.activFn)
+        outputs = blaze::map(outputs, [&layer](Real_t z) { return layer.activFn(z); });
+}
+
+using View_t = blaze::CustomVector<Real_t, blaze::unaligned, blaze::unpadded, true>;
+
+// blaze reductions do not accept views of const elements
+View_t const constView(Real_t const* data, Size_t size) { return View_t(const_cast<Real_t*>(data), size); }
+
+using SIMD_t = blaze::SIMDTrait_t<Real_t>;
+constexpr bool simdEnabled = blaze::HasSIMDSqrt_v<Real_t> && blaze::HasSIMDDiv_v<Real_t, Real_t>;
+
+template <typename Value_t>
+Value_t load(Real_t const* address)
+{
+    if constexpr (std::is_same_v<Value_t, Real_t>)
+        return *address;
+    else
+        return blaze::loadu(address);
+}
+
+template <typename Value_t>
+void store(Real_t* address, Value_t const& value)
+{
+    if constexpr (std::is_same_v<Value_t, Real_t>)
+        *address = value;
+    else
+        blaze::storeu(address, value);
+}
+
+template <typename Value_t>
+Value_t broadcast(Real_t value)
+{
+    if constexpr (std::is_same_v<Value_t, Real_t>)
+        return value;
+    else
+        return blaze::set(value);
+}
+
+// calls kernel(i, SIMD_t()) for every whole SIMD pack of [0, size) and kernel(i, Real_t()) for the rest
+template <typename Kernel_t>
+void fusedLoop(Size_t size, Kernel_t kernel)
+{
+    Size_t i = 0;
+    if constexpr (simdEnabled)
+        for (; i + SIMD_t::size <= size; i += SIMD_t::size)
+            kernel(i, SIMD_t());
+    for (; i < size; ++i)
+        kernel(i, Real_t());
+}
+
+// names of the activations in saved networks
+struct NamedActivation {
+    char const* name;
+    Layer::ActivFn_t activFn;
+    Layer::ActivFnDeriv_t activFnDeriv;
+};
+
+NamedActivation const activations[] = { { "linear", nullptr, nullptr }, { "sigmoid", SigmoidActivFn::Activation, SigmoidActivFn::Derivative } };
+
+char const fileMagic[8] = { 'B', 'P', 'D', 'E', 'N', 'S', 'E', '1' };
+
+constexpr Size_t LineFloats = sizeof(CacheLine_t) / sizeof(Real_t);
+
+Size_t paddedSize(Size_t n) { return blaze::nextMultiple<Size_t>(n, blaze::SIMDTrait_t<Real_t>::size); }
+
+Size_t linesOf(Size_t floats) { return (floats + LineFloats - 1) / LineFloats; }
+
+// the weights of a layer, then its biases from the next line on, on one line at least so that the
+// views of empty layers point somewhere
+Size_t layerLines(Size_t rows, Size_t columns)
+{
+    return linesOf(rows * paddedSize(columns)) + std::max<Size_t>(1, linesOf(paddedSize(columns)));
+}
+
+void viewLayer(CacheLine_t* lines, Size_t rows, Size_t columns, Layer::Weights_t& weights, Layer::Biases_t& biases)
+{
+    weights.reset(lines->values, rows, columns, paddedSize(columns));
+    biases.reset(lines[linesOf(rows * paddedSize(columns))].values, columns, paddedSize(columns));
+}
+
+} // namespace
 
 Layer::Layer(Size_t prevLayerSize, Size_t thisLayerSize, ActivFn_t aFn, ActivFnDeriv_t aFnD)
-    : weights(prevLayerSize, thisLayerSize),
-      biases(thisLayerSize),
-      activFn(aFn),
-      activFnDeriv(aFnD)
+    : activFn(aFn),
+      activFnDeriv(aFnD),
+      storage(layerLines(prevLayerSize, thisLayerSize))
 {
+    viewLayer(storage.data(), prevLayerSize, thisLayerSize, weights, biases);
     weights = blaze::map(weights, [](Real_t x) { return blaze::rand<Real_t>() * 2 - 1; });
 }
 
-std::pair<Layer::Vec_t, Layer::Vec_t> Layer::eval(Layer::Vec_t const& input) const
+Layer::Layer(Layer const& other)
+    : activFn(other.activFn),
+      activFnDeriv(other.activFnDeriv),
+      storage(layerLines(other.weights.rows(), other.weights.columns()))
 {
-    Vec_t zVec = input * weights + biases;
+    viewLayer(storage.data(), other.weights.rows(), other.weights.columns(), weights, biases);
+    weights = other.weights;
+    biases = other.biases;
+}
+
+Layer& Layer::operator=(Layer other) noexcept
+{
+    weights.swap(other.weights);
+    biases.swap(other.biases);
+    std::swap(activFn, other.activFn);
+    std::swap(activFnDeriv, other.activFnDeriv);
+    storage.swap(other.storage);
+    return *this;
+}
 
-    return activFn ? std::pair(blaze::map(zVec, [this](Real_t z) { return activFn(z); }), zVec)
+void Layer::bind(Weights_t& weightsBlock, Biases_t& biasesBlock)
+{
+    weights.reset(weightsBlock.data(), weightsBlock.rows(), weightsBlock.columns(), weightsBlock.spacing());
+    biases.reset(biasesBlock.data(), biasesBlock.size(), biasesBlock.capacity());
+    std::vector<CacheLine_t>().swap(storage);
+}
+
+ParameterArena::ParameterArena(std::vector<Layer> const& layers)
+{
+    Size_t lines = 0;
+    for (auto const& layer : layers) {
+        shapes.emplace_back(layer.weights.rows(), layer.weights.columns());
+        lines += layerLines(layer.weights.rows(), layer.weights.columns());
+    }
+    buffer.resize(lines);
+    bind();
+}
+
+ParameterArena::ParameterArena(ParameterArena const& other)
+    : shapes(other.shapes),
+      buffer(other.buffer)
+{
+    bind();
+}
+
+ParameterArena& ParameterArena::operator=(ParameterArena other) noexcept
+{
+    weights.swap(other.weights);
+    biases.swap(other.biases);
+    shapes.swap(other.shapes);
+    buffer.swap(other.buffer);
+    return *this;
+}
+
+void ParameterArena::bind()
+{
+    weights.resize(shapes.size());
+    biases.resize(shapes.size());
+    CacheLine_t* lines = buffer.data();
+    for (Size_t s = 0; s < shapes.size(); ++s) {
+        auto const [rows, columns] = shapes[s];
+        viewLayer(lines, rows, columns, weights[s], biases[s]);
+        lines += layerLines(rows, columns);
+    }
+}
+
+template <typename Input_t>
+std::pair<Layer::Output_t<Input_t>, Layer::Output_t<Input_t>> Layer::evalImpl(Input_t const& input) const
+{
+    Output_t<Input_t> zVec;
+    if constexpr (std::is_same_v<Input_t, Batch_t>)
+        gemm(input, false, weights, false, zVec);
+    else
+        zVec = input * weights;
+    if constexpr (blaze::IsMatrix_v<Input_t>)
+        zVec += blaze::expand(biases, input.rows());
+    else
+        zVec += biases;
+
+    return activFn ? std::pair(Output_t<Input_t>(blaze::map(zVec, [this](Real_t z) { return activFn(z); })), zVec)
                    : std::pair(zVec, zVec);
 }
 
+std::pair<Layer::Vec_t, Layer::Vec_t> Layer::eval(Layer::Vec_t const& input) const { return evalImpl(input); }
+
+std::pair<Layer::Vec_t, Layer::Vec_t> Layer::eval(Layer::SparseVec_t const& input) const { return evalImpl(input); }
+
+std::pair<Layer::Batch_t, Layer::Batch_t> Layer::eval(Layer::Batch_t const& inputs) const { return evalImpl(inputs); }
+
+std::pair<Layer::Batch_t, Layer::Batch_t> Layer::eval(Layer::SparseBatch_t const& inputs) const { return evalImpl(inputs); }
+
+char const* Layer::activationName(ActivFn_t activFn)
+{
+    auto const named = std::find_if(std::begin(activations), std::end(activations), [&](auto const& a) { return a.activFn == activFn; });
+    return named != std::end(activations) ? named->name : nullptr;
+}
+
+bool Layer::activationFns(std::string const& name, ActivFn_t& activFn, ActivFnDeriv_t& activFnDeriv)
+{
+    auto const named = std::find_if(std::begin(activations), std::end(activations), [&](auto const& a) { return name == a.name; });
+    if (named == std::end(activations))
+        return false;
+    activFn = named->activFn;
+    activFnDeriv = named->activFnDeriv;
+    return true;
+}
+
+bool Layer::setActivFn(std::string const& name) { return activationFns(name, activFn, activFnDeriv); }
+
 Layer::Vec_t Layer::evalDerivZ(Layer::Vec_t const& z) const
 {
     return activFnDeriv ? blaze::map(z, [this](Real_t z) { return activFnDeriv(z); })
                         : Vec_t(biases.size(), 1);
 }
 
+Layer::Batch_t Layer::evalDerivZ(Layer::Batch_t const& z) const
+{
+    return activFnDeriv ? blaze::map(z, [this](Real_t z) { return activFnDeriv(z); })
+                        : Batch_t(z.rows(), z.columns(), 1);
+}
+
+void Layer::multiplyDerivZ(Layer::Vec_t const& z, Layer::Vec_t& derivative) const
+{
+    if (activFnDeriv)
+        derivative *= blaze::map(z, [this](Real_t z) { return activFnDeriv(z); });
+}
+
+void Layer::multiplyDerivZ(Layer::Batch_t const& z, Layer::Batch_t& derivative) const
+{
+    if (activFnDeriv)
+        derivative %= blaze::map(z, [this](Real_t z) { return activFnDeriv(z); });
+}
+
+Real_t MSELoss::Value(Layer const&, Real_t const*, Real_t const* fz, Real_t const* target, Size_t size)
+{
+    return blaze::sqrNorm(constView(fz, size) - constView(target, size)) / size;
+}
+
+void MSELoss::Delta(Layer const& output, Real_t const* z, Real_t const* fz, Real_t const* target, Real_t* delta, Size_t size)
+{
+    View_t deltaVec(delta, size);
+    Real_t const scale = Real_t(2) / size;
+    if (output.activFnDeriv)
+        deltaVec = scale * (constView(fz, size) - constView(target, size)) * blaze::map(constView(z, size), [&output](Real_t z) { return output.activFnDeriv(z); });
+    else
+        deltaVec = scale * (constView(fz, size) - constView(target, size));
+}
+
+// log(sum(exp(z))) = max + log(sum(exp(z - max))) never overflows
+Real_t SoftmaxCrossEntropyLoss::Value(Layer const&, Real_t const* z, Real_t const*, Real_t const* target, Size_t size)
+{
+    View_t const zVec = constView(z, size);
+    View_t const targetVec = constView(target, size);
+    Real_t const zMax = blaze::max(zVec);
+    Real_t const logSumExp = zMax + std::log(blaze::sum(blaze::exp(zVec - zMax)));
+    return logSumExp * blaze::sum(targetVec) - blaze::dot(targetVec, zVec);
+}
+
+// the probabilities are written once, straight into delta, and turned into the delta in place
+void SoftmaxCrossEntropyLoss::Delta(Layer const&, Real_t const* z, Real_t const*, Real_t const* target, Real_t* delta, Size_t size)
+{
+    View_t const zVec = constView(z, size);
+    View_t const targetVec = constView(target, size);
+    View_t deltaVec(delta, size);
+    deltaVec = blaze::exp(zVec - blaze::max(zVec));
+    deltaVec = (blaze::sum(targetVec) / blaze::sum(deltaVec)) * deltaVec - targetVec;
+}
+
+// log(1 + exp(z)) - t * z, written as max(z, 0) - t * z + log(1 + exp(-|z|)) to never overflow
+Real_t BinaryCrossEntropyLoss::Value(Layer const&, Real_t const* z, Real_t const*, Real_t const* target, Size_t size)
+{
+    View_t const zVec = constView(z, size);
+    return blaze::sum(blaze::max(zVec, Real_t(0)) - constView(target, size) * zVec +
+                      blaze::log(1 + blaze::exp(-blaze::abs(zVec)))) / size;
+}
+
+void BinaryCrossEntropyLoss::Delta(Layer const&, Real_t const* z, Real_t const*, Real_t const* target, Real_t* delta, Size_t size)
+{
+    View_t(delta, size) = (1 / (1 + blaze::exp(-constView(z, size))) - constView(target, size)) / Real_t(size);
+}
+
+void Optimizer::update(Size_t slot, Size_t blockSize, Size_t offset, Real_t* params, Real_t const* gradient, Size_t size,
+                       Real_t gradientScale)
+{
+    if (slots.size() <= slot)
+        slots.resize(slot + 1);
+    auto& states = slots[slot];
+    // a block that changed size was repacked, the old state no longer lines up with its parameters
+    if (states.size() != stateCount() || (!states.empty() && states.front().size() != blockSize))
+        states.assign(stateCount(), std::vector<Real_t>(blockSize, 0));
+
+    std::array<Real_t*, 2> state{};
+    for (Size_t i = 0; i < states.size(); ++i)
+        state[i] = states[i].data() + offset;
+    update(params, gradient, gradientScale, state.data(), size);
+}
+
+void SGD::update(Real_t* params, Real_t const* gradient, Real_t gradientScale, Real_t* const* state, Size_t size) const
+{
+    if (!momentum)
+        return fusedLoop(size, [&](Size_t i, auto value) {
+            using V = decltype(value);
+            store(params + i, load<V>(params + i) - broadcast<V>(learningRate * gradientScale) * load<V>(gradient + i));
+        });
+
+    fusedLoop(size, [&](Size_t i, auto value) {
+        using V = decltype(value);
+        V const g = broadcast<V>(gradientScale) * load<V>(gradient + i);
+        V const v = broadcast<V>(momentum) * load<V>(state[0] + i) + g;
+        V const step = nesterov ? V(g + broadcast<V>(momentum) * v) : v;
+        store(state[0] + i, v);
+        store(params + i, load<V>(params + i) - broadcast<V>(learningRate) * step);
+    });
+}
+
+void RMSProp::update(Real_t* params, Real_t const* gradient, Real_t gradientScale, Real_t* const* state, Size_t size) const
+{
+    fusedLoop(size, [&](Size_t i, auto value) {
+        using V = decltype(value);
+        V const g = broadcast<V>(gradientScale) * load<V>(gradient + i);
+        V const s = broadcast<V>(decay) * load<V>(state[0] + i) + broadcast<V>(1 - decay) * (g * g);
+        store(state[0] + i, s);
+        store(params + i, load<V>(params + i) - broadcast<V>(learningRate) * g / (blaze::sqrt(s) + broadcast<V>(epsilon)));
+    });
+}
+
+void Adam::update(Real_t* params, Real_t const* gradient, Real_t gradientScale, Real_t* const* state, Size_t size) const
+{
+    Real_t const correction1 = 1 / (1 - std::pow(beta1, Real_t(step)));
+    Real_t const correction2 = 1 / (1 - std::pow(beta2, Real_t(step)));
+
+    fusedLoop(size, [&](Size_t i, auto value) {
+        using V = decltype(value);
+        V const g = broadcast<V>(gradientScale) * load<V>(gradient + i);
+        V const w = load<V>(params + i);
+        V const m = broadcast<V>(beta1) * load<V>(state[0] + i) + broadcast<V>(1 - beta1) * g;
+        V const v = broadcast<V>(beta2) * load<V>(state[1] + i) + broadcast<V>(1 - beta2) * (g * g);
+        V const direction = broadcast<V>(correction1) * m / (blaze::sqrt(broadcast<V>(correction2) * v) + broadcast<V>(epsilon));
+        store(state[0] + i, m);
+        store(state[1] + i, v);
+        store(params + i, w - broadcast<V>(learningRate) * (direction + broadcast<V>(weightDecay) * w));
+    });
+}
+
+void Layer::infer(Layer::Batch_t const& inputs, Layer::Batch_t& outputs) const { inferBatch(*this, inputs, outputs); }
+
+EmbeddingLayer::EmbeddingLayer(Size_t vocabularySize, Size_t dimension)
+    : table(vocabularySize, dimension),
+      firstMoments(vocabularySize, dimension, 0),
+      secondMoments(vocabularySize, dimension, 0),
+      lastSteps(vocabularySize, 0)
+{
+    table = blaze::map(table, [](Real_t) { return blaze::rand<Real_t>() * 2 - 1; });
+}
+
+Layer::Vec_t EmbeddingLayer::eval(Ids_t const& ids) const
+{
+    Layer::Vec_t output(table.columns(), 0);
+    for (Size_t id : ids)
+        output += blaze::row(table, id);
+    return output;
+}
+
+void EmbeddingLayer::update(Ids_t const& ids, Layer::Vec_t const& outputDerivative)
+{
+    ++step;
+    Real_t const correction1 = 1 - std::pow(beta1, Real_t(step));
+    Real_t const correction2 = 1 - std::pow(beta2, Real_t(step));
+
+    // a row repeated n times in the bag receives n times the output derivative
+    Ids_t sorted = ids;
+    std::sort(sorted.begin(), sorted.end());
+    for (auto it = sorted.begin(); it != sorted.end();) {
+        auto const next = std::upper_bound(it, sorted.end(), *it);
+        Size_t const id = *it;
+        Real_t const count = Real_t(next - it);
+        it = next;
+
+        // the moments of the steps in which the row was not touched decay without any gradient
+        Size_t const skipped = lastSteps[id] ? step - lastSteps[id] - 1 : 0;
+        auto m = blaze::row(firstMoments, id);
+        auto v = blaze::row(secondMoments, id);
+        if (skipped) {
+            m *= std::pow(beta1, Real_t(skipped));
+            v *= std::pow(beta2, Real_t(skipped));
+        }
+        m = beta1 * m + ((1 - beta1) * count) * outputDerivative;
+        v = beta2 * v + ((1 - beta2) * count * count) * (outputDerivative * outputDerivative);
+        blaze::row(table, id) -= learningRate * (m / correction1) / (blaze::sqrt(v / correction2) + epsilon);
+        lastSteps[id] = step;
+    }
+}
+
+DenseNN::DenseNN(DenseNN const& other)
+    : embedding(other.embedding),
+      layers(other.layers),
+      optimizer(other.optimizer->clone()),
+      lossFn(other.lossFn),
+      lossDeltaFn(other.lossDeltaFn),
+      linearOutputLoss(other.linearOutputLoss),
+      checkpointInterval(other.checkpointInterval),
+      inPlaceUpdates(other.inPlaceUpdates),
+      deterministicBlockRows(other.deterministicBlockRows),
+      learnGradient(other.learnGradient),
+      executionPlan(other.executionPlan)
+{
+    pack();
+}
+
+DenseNN::DenseNN(DenseNN&& other)
+{
+    other.executor.reset();
+    swap(other);
+}
+
+DenseNN& DenseNN::operator=(DenseNN other)
+{
+    executor.reset();
+    swap(other);
+    return *this;
+}
+
+void DenseNN::pack()
+{
+    ParameterArena packed(layers);
+    for (Size_t s = 0; s < layers.size(); ++s) {
+        packed.weights[s] = layers[s].weights;
+        packed.biases[s] = layers[s].biases;
+        layers[s].bind(packed.weights[s], packed.biases[s]);
+    }
+    arena = std::move(packed);
+}
+
+DenseNN& DenseNN::randomize(std::uint64_t seed)
+{
+    for (Size_t s = 0; s < layers.size(); ++s) {
+        auto& weights = layers[s].weights;
+        std::uint64_t const key = counterRandom(seed, s);
+        for (Size_t i = 0; i < weights.rows(); ++i)
+            for (Size_t j = 0; j < weights.columns(); ++j)
+                weights(i, j) = counterUniform(key, i * weights.columns() + j) * 2 - 1;
+        blaze::reset(layers[s].biases);
+    }
+    return *this;
+}
+
+void DenseNN::setParameters(ParameterArena const& checkpoint)
+{
+    if (!arena.sameLayout(checkpoint))
+        throw std::logic_error("The parameters are of layers of other shapes");
+    std::memcpy(arena.data(), checkpoint.data(), arena.size() * sizeof(Real_t));
+}
+
+void DenseNN::swap(DenseNN& other)
+{
+    std::swap(embedding, other.embedding);
+    std::swap(layers, other.layers);
+    std::swap(arena, other.arena);
+    std::swap(optimizer, other.optimizer);
+    std::swap(learnGradient, other.learnGradient);
+    std::swap(partialGradients, other.partialGradients);
+    std::swap(lossFn, other.lossFn);
+    std::swap(lossDeltaFn, other.lossDeltaFn);
+    std::swap(linearOutputLoss, other.linearOutputLoss);
+    std::swap(checkpointInterval, other.checkpointInterval);
+    std::swap(inPlaceUpdates, other.inPlaceUpdates);
+    std::swap(deterministicBlockRows, other.deterministicBlockRows);
+    std::swap(executionPlan, other.executionPlan);
+}
+
 Layer::Vec_t DenseNN::operator()(Layer::Vec_t input) const
 {
     for (auto const& layer : layers)
@@ -34,37 +567,546 @@ Layer::Vec_t DenseNN::operator()(Layer::Vec_t input) const
     return input;
 }
 
-std::pair<std::vector<Layer::Weights_t>, std::vector<Layer::Vec_t>>
-DenseNN::gradient(Layer::Vec_t const& input, Layer::Vec_t const& targetOutput) const
+Layer::Vec_t DenseNN::embed(EmbeddingLayer::Ids_t const& ids) const
 {
+    if (!embedding)
+        throw std::logic_error("Network has no embedding stage");
+    return embedding->eval(ids);
+}
+
+template <typename Input_t>
+Layer::Output_t<Input_t> DenseNN::forward(Input_t const& input) const
+{
+    if constexpr (std::is_same_v<Input_t, Layer::Batch_t>)
+        if (executionPlan)
+            return forwardPlanned(input);
+
+    Layer::Output_t<Input_t> output = layers.front().eval(input).first;
+    for (Size_t s = 1; s < layers.size(); ++s)
+        output = layers[s].eval(output).first;
+    return output;
+}
+
+void DenseNN::checkTargets(Size_t samples, Size_t targetRows, Size_t targetSize) const
+{
+    if (targetSize != layers.back().biases.size())
+        throw std::logic_error("The targets are not of the output layer's size");
+    if (targetRows != samples)
+        throw std::logic_error("There is not one target for every input");
+}
+
+template <typename Input_t, typename Consume_t>
+void DenseNN::backprop(Input_t const& input, Layer::Output_t<Input_t> const& targetOutput, Consume_t consume,
+                       Layer::Output_t<Input_t>* inputDerivative) const
+{
+    using Output_t = Layer::Output_t<Input_t>;
+
+    if (linearOutputLoss && layers.back().activFn)
+        throw std::logic_error("The loss needs a linear output layer");
+    if constexpr (blaze::IsMatrix_v<Input_t>)
+        checkTargets(input.rows(), targetOutput.rows(), targetOutput.columns());
+    else
+        checkTargets(1, 1, targetOutput.size());
+
+    // segments of k layers, all of them but the last are recomputed during the backward pass
     Size_t const S = layers.size();
-    std::vector<Layer::Vec_t> zDerivatives(S);
-    std::vector<Layer::Vec_t> zValues;
-    std::vector<Layer::Vec_t> fzValues;
-    Layer::Vec_t prev = input;
+    Size_t const k = checkpointInterval ? checkpointInterval : S;
+    Size_t const lastStart = (S - 1) / k * k;
+    auto const isCheckpoint = [&](Size_t s) { return s < lastStart && s % k == k - 1; };
+
+    std::vector<Output_t> zValues(S);
+    std::vector<Output_t> fzValues(S);
+    auto const evalLayer = [&](Size_t s) {
+        if (s)
+            std::tie(fzValues[s], zValues[s]) = layers[s].eval(fzValues[s - 1]);
+        else
+            std::tie(fzValues[s], zValues[s]) = layers[s].eval(input);
+    };
+
+    for (Size_t s = 0; s < S; ++s) {
+        evalLayer(s);
+        if (s < lastStart)
+            zValues[s] = Output_t();
+        if (s && s - 1 < lastStart && !isCheckpoint(s - 1))
+            fzValues[s - 1] = Output_t();
+    }
+
+    Output_t delta, below;
+    resizeLike(delta, zValues.back());
+    for (Size_t i = 0; i < sampleCount(delta); ++i)
+        lossDeltaFn(layers.back(), sampleData(zValues.back(), i), sampleData(fzValues.back(), i),
+                    sampleData(targetOutput, i), sampleData(delta, i), layers.back().biases.size());
+
+    for (Size_t end = S; end > 0;) {
+        Size_t const start = (end - 1) / k * k;
+        if (start < lastStart)
+            for (Size_t s = start; s < end; ++s)
+                evalLayer(s);
+
+        // a layer is consumed once the delta below it is known, so consume may update its weights
+        for (Size_t s = end; s-- > start;) {
+            if (s != S - 1) {
+                backPropagate(delta, layers[s + 1], layers[s], zValues[s], below);
+                consume(s + 1, fzValues[s], delta);
+                std::swap(delta, below);
+            }
+            zValues[s] = Output_t();
+            fzValues[s] = Output_t();
+        }
+        end = start;
+    }
+
+    if (inputDerivative)
+        *inputDerivative = backPropagate(delta, layers.front().weights);
+    consume(0, input, delta);
+}
 
+template <typename Input_t>
+void DenseNN::backprop(Input_t const& input, Layer::Output_t<Input_t> const& targetOutput, Gradient& gradient,
+                       Layer::Output_t<Input_t>* inputDerivative) const
+{
+    backprop(
+        input, targetOutput,
+        [&gradient](Size_t s, auto const& layerInput, auto const& delta) {
+            addOuter(gradient.weights[s], gradient.inputRows, layerInput, delta);
+            addBiasOuter(gradient.biases[s], delta);
+        },
+        inputDerivative);
+    gradient.denseInput |= blaze::IsDenseVector_v<Input_t> || blaze::IsDenseMatrix_v<Input_t>;
+    gradient.samples += sampleCount(targetOutput);
+}
+
+void DenseNN::save(std::string const& path) const
+{
+    if (embedding)
+        throw std::logic_error("Networks with an embedding stage cannot be saved");
+
+    std::ofstream file(path, std::ios::binary);
+    auto const write = [&](void const* data, Size_t bytes) { file.write(static_cast<char const*>(data), bytes); };
+    write(fileMagic, sizeof(fileMagic));
+    std::uint64_t const layerCount = layers.size();
+    write(&layerCount, sizeof(layerCount));
     for (auto const& layer : layers) {
-        auto [fz, z] = layer.eval(prev);
-        zValues.push_back(z);
-        fzValues.push_back(prev = fz);
+        char const* const activation = Layer::activationName(layer.activFn);
+        if (!activation)
+            throw std::logic_error("The activation of a layer has no saved name");
+
+        char name[16] = {};
+        std::strncpy(name, activation, sizeof(name) - 1);
+        std::uint64_t const shape[2] = { layer.weights.rows(), layer.weights.columns() };
+        write(shape, sizeof(shape));
+        write(name, sizeof(name));
+        for (Size_t i = 0; i < layer.weights.rows(); ++i)
+            write(layer.weights.data(i), layer.weights.columns() * sizeof(Real_t));
+        write(layer.biases.data(), layer.biases.size() * sizeof(Real_t));
+    }
+    if (!file)
+        throw std::runtime_error("Could not write the network to " + path);
+}
+
+DenseNN DenseNN::load(std::string const& path)
+{
+    std::ifstream file(path, std::ios::binary);
+    auto const read = [&](void* data, Size_t bytes) {
+        if (!file.read(static_cast<char*>(data), bytes))
+            throw std::runtime_error("Could not read a network from " + path);
+    };
+
+    char magic[sizeof(fileMagic)];
+    read(magic, sizeof(magic));
+    if (!std::equal(magic, magic + sizeof(magic), fileMagic))
+        throw std::runtime_error(path + " is not a saved network");
+
+    DenseNN network;
+    std::uint64_t layerCount;
+    read(&layerCount, sizeof(layerCount));
+    for (std::uint64_t s = 0; s < layerCount; ++s) {
+        std::uint64_t shape[2];
+        char name[16];
+        read(shape, sizeof(shape));
+        read(name, sizeof(name));
+        name[sizeof(name) - 1] = 0;
+        if (s ? shape[0] != network.layers.back().weights.columns() : !shape[0])
+            throw std::runtime_error(path + " has layers of mismatched sizes");
+        Layer& layer = network.layers.emplace_back(shape[0], shape[1]);
+        if (!layer.setActivFn(name))
+            throw std::runtime_error(path + " uses the unknown activation " + name);
+        for (Size_t i = 0; i < layer.weights.rows(); ++i)
+            read(layer.weights.data(i), layer.weights.columns() * sizeof(Real_t));
+        read(layer.biases.data(), layer.biases.size() * sizeof(Real_t));
     }
+    network.pack();
+    return network;
+}
 
-    std::vector<Layer::Weights_t> wDerivatives(S);
-    zDerivatives.back() = Real_t(2) / S * ((fzValues.back() - targetOutput) * layers.back().evalDerivZ(zValues.back()));
-    for (std::ptrdiff_t s = S - 2; s >= 0; --s)
-        zDerivatives[s] = blaze::trans(layers[s + 1].weights * blaze::trans(zDerivatives[s + 1])) * layers[s].evalDerivZ(zValues[s]);
-    for (std::ptrdiff_t s = S - 1; s > 0; --s)
-        wDerivatives[s] = blaze::trans(fzValues[s - 1]) * zDerivatives[s];
-    wDerivatives.front() = blaze::trans(input) * zDerivatives.front();
-    return std::pair(wDerivatives, zDerivatives);
+DenseNN DenseNN::loadModel(std::string const& model)
+{
+    if (model.rfind("random:", 0))
+        return load(model);
+
+    std::vector<Size_t> sizes;
+    std::istringstream list(model.substr(7));
+    for (std::string size; std::getline(list, size, ',');)
+        sizes.push_back(std::stoul(size));
+    if (sizes.size() < 2)
+        throw std::logic_error("A random model needs an input size and at least one layer");
+
+    DenseNN network;
+    network.addLayer<SigmoidActivFn>(sizes[1], sizes[0]);
+    for (Size_t i = 2; i < sizes.size(); ++i)
+        if (i + 1 < sizes.size())
+            network.addLayer<SigmoidActivFn>(sizes[i]);
+        else
+            network.addLayer(sizes[i]);
+    return network;
 }
 
-void DenseNN::learn(Layer::Vec_t const& input, Layer::Vec_t const& targetOutput)
+DenseNN::CheckpointReport DenseNN::checkpointReport(Size_t batchSize) const
 {
-    auto [wGradient, bGradient] = gradient(input, targetOutput);
+    CheckpointReport report;
+    Size_t const S = report.layers = layers.size();
+    Size_t const k = checkpointInterval ? checkpointInterval : S;
+    Size_t const lastStart = S ? (S - 1) / k * k : 0;
+    Size_t const sampleBytes = batchSize * sizeof(Real_t);
 
-    for (std::ptrdiff_t s = 0; s < layers.size(); ++s) {
-        layers[s].weights -= 0.1 * wGradient[s];
-        layers[s].biases -= 0.1 * bGradient[s];
+    // z and f(z) of the segment being processed, on top of the checkpoints of the earlier segments
+    Size_t checkpoints = 0;
+    Size_t largestSegment = 0;
+    for (Size_t start = 0; start < S; start += k) {
+        Size_t segment = 0;
+        for (Size_t s = start; s < std::min(start + k, S); ++s)
+            segment += 2 * layers[s].biases.size();
+        largestSegment = std::max(largestSegment, segment);
+        report.fullActivationBytes += segment * sampleBytes;
+        if (start + k <= lastStart)
+            checkpoints += layers[start + k - 1].biases.size();
     }
-}
\ No newline at end of file
+    report.activationBytes = (checkpoints + largestSegment) * sampleBytes;
+    report.recomputedLayers = lastStart;
+    return report;
+}
+
+Metrics DenseNN::evaluate(Dataset const& dataset, Size_t threads, Size_t batchSize) const
+{
+    if (!batchSize)
+        throw std::logic_error("The batch size must be at least 1");
+    if (layers.empty())
+        throw std::logic_error("Network has no layers");
+    if (dataset.inputs.columns() != layers.front().weights.rows())
+        throw std::logic_error("The inputs are not of the first layer's size");
+    checkTargets(dataset.inputs.rows(), dataset.targets.rows(), dataset.targets.columns());
+
+    Size_t const rows = dataset.inputs.rows();
+    Size_t const outputs = layers.back().biases.size();
+    if (!threads)
+        threads = std::max(1u, std::thread::hardware_concurrency());
+    threads = std::max<Size_t>(1, std::min(threads, rows / batchSize));
+
+    bool const binaryLabels = outputs == 1 || lossFn == BinaryCrossEntropyLoss::Value;
+    Real_t const threshold = linearOutputLoss ? 0 : 0.5f;
+
+    struct Sums {
+        double loss = 0;
+        double correct = 0;
+        double absoluteError = 0;
+    };
+    std::vector<Sums> partials(threads);
+
+    auto evaluateRows = [&](Size_t thread) {
+        Size_t const begin = rows * thread / threads;
+        Size_t const end = rows * (thread + 1) / threads;
+        Layer::Batch_t buffers[2];
+        Sums& sums = partials[thread];
+
+        for (Size_t first = begin; first < end; first += batchSize) {
+            Size_t const count = std::min(batchSize, end - first);
+            auto const inputs = blaze::submatrix(dataset.inputs, first, 0, count, dataset.inputs.columns());
+            auto const targets = blaze::submatrix(dataset.targets, first, 0, count, outputs);
+
+            inferBatch(layers.front(), inputs, buffers[0]);
+            for (Size_t s = 1; s < layers.size(); ++s)
+                inferBatch(layers[s], buffers[(s - 1) % 2], buffers[s % 2]);
+            Layer::Batch_t const& output = buffers[(layers.size() - 1) % 2];
+
+            // the output of a linear-output loss is z itself, the other losses only need f(z)
+            for (Size_t i = 0; i < count; ++i)
+                sums.loss += lossFn(layers.back(), output.data(i), output.data(i), dataset.targets.data(first + i), outputs);
+            sums.absoluteError += blaze::sum(blaze::abs(output - targets));
+            if (binaryLabels)
+                sums.correct += blaze::sum(blaze::map(output, targets, [threshold](Real_t o, Real_t t) {
+                                    return Real_t((o > threshold) == (t > 0.5f));
+                                })) / outputs;
+            else
+                for (Size_t i = 0; i < count; ++i)
+                    sums.correct += blaze::argmax(blaze::row(output, i)) == blaze::argmax(blaze::row(targets, i));
+        }
+    };
+
+    std::vector<std::thread> workers;
+    for (Size_t t = 1; t < threads; ++t)
+        workers.emplace_back(evaluateRows, t);
+    evaluateRows(0);
+    for (auto& worker : workers)
+        worker.join();
+
+    Sums total;
+    for (auto const& sums : partials) {
+        total.loss += sums.loss;
+        total.correct += sums.correct;
+        total.absoluteError += sums.absoluteError;
+    }
+
+    Metrics metrics;
+    if (rows) {
+        metrics.loss = Real_t(total.loss / rows);
+        metrics.accuracy = Real_t(total.correct / rows);
+        metrics.meanAbsoluteError = Real_t(total.absoluteError / (rows * outputs));
+    }
+    return metrics;
+}
+
+DenseNN::Gradient& DenseNN::Gradient::operator+=(Gradient const& other)
+{
+    if (!sameLayout(other))
+        throw std::logic_error("The gradients are of layers of different shapes");
+
+    flat() += other.flat();
+    inputRows.insert(inputRows.end(), other.inputRows.begin(), other.inputRows.end());
+    denseInput |= other.denseInput;
+    samples += other.samples;
+    return *this;
+}
+
+DenseNN::Gradient DenseNN::makeGradient() const { return Gradient(layers); }
+
+std::pair<std::vector<blaze::DynamicMatrix<Real_t>>, std::vector<Layer::Vec_t>>
+DenseNN::gradient(Layer::Vec_t const& input, Layer::Vec_t const& targetOutput) const
+{
+    Gradient gradient = makeGradient();
+    accumulateGradient(input, targetOutput, gradient);
+    return std::pair(std::vector<blaze::DynamicMatrix<Real_t>>(gradient.weights.begin(), gradient.weights.end()),
+                     std::vector<Layer::Vec_t>(gradient.biases.begin(), gradient.biases.end()));
+}
+
+template <typename Input_t>
+void DenseNN::accumulateGradientImpl(Input_t const& input, Layer::Output_t<Input_t> const& targetOutput, Gradient& gradient) const
+{
+    backprop(input, targetOutput, gradient);
+}
+
+void DenseNN::accumulateGradient(Layer::Vec_t const& input, Layer::Vec_t const& targetOutput, Gradient& gradient) const
+{
+    accumulateGradientImpl(input, targetOutput, gradient);
+}
+
+void DenseNN::accumulateGradient(Layer::Batch_t const& inputs, Layer::Batch_t const& targetOutputs, Gradient& gradient,
+                                 std::function<void(Size_t layer)> const& layerDone) const
+{
+    backprop(inputs, targetOutputs, [&](Size_t s, Layer::Batch_t const& layerInput, Layer::Batch_t const& delta) {
+        addOuter(gradient.weights[s], gradient.inputRows, layerInput, delta);
+        addBiasOuter(gradient.biases[s], delta);
+        layerDone(s);
+    });
+    gradient.denseInput = true;
+    gradient.samples += inputs.rows();
+}
+
+void DenseNN::applyGradient(Gradient& gradient)
+{
+    if (!gradient.samples)
+        return;
+    if (!arena.sameLayout(gradient))
+        throw std::logic_error("The gradient is not shaped like the layers");
+
+    // One block of optimizer state over the whole arena, updated in a single pass from the biases
+    // of the first layer on, or from its weights, which start the arena, once an input was dense.
+    // Sparse inputs only update the rows they touched of the first weights.
+    Real_t const scale = Real_t(1) / gradient.samples;
+    Size_t const size = arena.size();
+    Size_t const start = gradient.denseInput ? 0 : arena.biases.front().data() - arena.data();
+    optimizer->nextStep();
+    optimizer->update(0, size, start, arena.data() + start, gradient.data() + start, size - start, scale);
+    std::fill(gradient.data() + start, gradient.data() + size, Real_t(0));
+    if (!gradient.denseInput) {
+        auto& rows = gradient.inputRows;
+        std::sort(rows.begin(), rows.end());
+        rows.erase(std::unique(rows.begin(), rows.end()), rows.end());
+
+        auto& weights = layers.front().weights;
+        for (Size_t r : rows) {
+            optimizer->update(0, size, r * weights.spacing(), weights.data(r), gradient.weights.front().data(r),
+                              weights.columns(), scale);
+            blaze::reset(blaze::row(gradient.weights.front(), r));
+        }
+    }
+
+    gradient.inputRows.clear();
+    gradient.denseInput = false;
+    gradient.samples = 0;
+}
+
+namespace {
+
+// fn(t) for t in [0, threads), fn(0) on the calling thread; every thread is joined before the
+// first exception of any of them is rethrown
+template <typename Fn_t>
+void runThreads(Size_t threads, Fn_t fn)
+{
+    std::vector<std::exception_ptr> errors(threads);
+    auto const run = [&](Size_t t) {
+        try {
+            fn(t);
+        }
+        catch (...) {
+            errors[t] = std::current_exception();
+        }
+    };
+
+    std::vector<std::thread> workers;
+    try {
+        for (Size_t t = 1; t < threads; ++t)
+            workers.emplace_back(run, t);
+    }
+    catch (...) {
+        errors[0] = std::current_exception();
+    }
+    if (!errors[0])
+        run(0);
+    for (auto& worker : workers)
+        worker.join();
+    for (auto const& error : errors)
+        if (error)
+            std::rethrow_exception(error);
+}
+
+} // namespace
+
+void DenseNN::learnParallel(Layer::Batch_t const& inputs, Layer::Batch_t const& targetOutputs, Size_t threads)
+{
+    if (embedding)
+        throw std::logic_error("learnParallel does not take an embedding stage");
+    if (layers.empty())
+        throw std::logic_error("Network has no layers");
+    if (inputs.columns() != layers.front().weights.rows())
+        throw std::logic_error("The inputs are not of the first layer's size");
+    checkTargets(inputs.rows(), targetOutputs.rows(), targetOutputs.columns());
+    Size_t const rows = inputs.rows();
+    if (!rows)
+        return;
+    if (!threads)
+        threads = std::max(1u, std::thread::hardware_concurrency());
+    if (learnGradient.weights.size() != layers.size())
+        learnGradient = makeGradient();
+
+    auto const accumulateRows = [&](Size_t begin, Size_t end, Gradient& gradient) {
+        Layer::Batch_t const targets = blaze::submatrix(targetOutputs, begin, 0, end - begin, targetOutputs.columns());
+        accumulateGradient(blaze::submatrix(inputs, begin, 0, end - begin, inputs.columns()), targets, gradient);
+    };
+    Size_t const slots = deterministicBlockRows ? DeterministicSlots : std::min(threads, rows);
+    partialGradients.resize(slots);
+    for (auto& partial : partialGradients)
+        if (!arena.sameLayout(partial))
+            partial = makeGradient();
+
+    if (!deterministicBlockRows) {
+        std::mutex mutex;
+        runThreads(slots, [&](Size_t t) {
+            Gradient& partial = partialGradients[t];
+            accumulateRows(rows * t / slots, rows * (t + 1) / slots, partial);
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                learnGradient += partial;
+            }
+            std::fill(partial.data(), partial.data() + partial.size(), Real_t(0));
+        });
+    }
+    else {
+        // waves of up to DeterministicSlots blocks: any thread sums a block into the slot of its
+        // index, then the slots are added up element by element along the same tree every time,
+        // each thread taking a range of cache lines
+        Size_t const blocks = (rows + deterministicBlockRows - 1) / deterministicBlockRows;
+        Size_t const lines = learnGradient.size() / (sizeof(CacheLine_t) / sizeof(Real_t));
+        for (Size_t wave = 0; wave < blocks; wave += slots) {
+            Size_t const count = std::min(slots, blocks - wave);
+            std::atomic<Size_t> nextBlock{ 0 };
+            runThreads(std::min(threads, count), [&](Size_t) {
+                for (Size_t b; (b = nextBlock++) < count;) {
+                    Size_t const begin = (wave + b) * deterministicBlockRows;
+                    accumulateRows(begin, std::min(rows, begin + deterministicBlockRows), partialGradients[b]);
+                }
+            });
+
+            Size_t const reducers = std::min(threads, lines);
+            runThreads(reducers, [&](Size_t t) {
+                Size_t const begin = lines * t / reducers * (sizeof(CacheLine_t) / sizeof(Real_t));
+                Size_t const size = lines * (t + 1) / reducers * (sizeof(CacheLine_t) / sizeof(Real_t)) - begin;
+                for (Size_t stride = 1; stride < count; stride *= 2)
+                    for (Size_t i = 0; i + stride < count; i += 2 * stride)
+                        blaze::subvector(partialGradients[i].flat(), begin, size) +=
+                            blaze::subvector(partialGradients[i + stride].flat(), begin, size);
+                blaze::subvector(learnGradient.flat(), begin, size) += blaze::subvector(partialGradients[0].flat(), begin, size);
+                for (Size_t i = 0; i < count; ++i)
+                    blaze::reset(blaze::subvector(partialGradients[i].flat(), begin, size));
+            });
+        }
+    }
+
+    for (auto& partial : partialGradients) {
+        partial.denseInput = false;
+        partial.samples = 0;
+    }
+    learnGradient.denseInput = true;
+    learnGradient.samples = rows;
+    applyGradient(learnGradient);
+}
+
+template <typename Input_t>
+void DenseNN::learnImpl(Input_t const& input, Layer::Output_t<Input_t> const& targetOutput,
+                        Layer::Output_t<Input_t>* inputDerivative)
+{
+    auto const* const sgd = dynamic_cast<SGD const*>(optimizer.get());
+    if (!inPlaceUpdates || !sgd || sgd->momentum) {
+        if (learnGradient.weights.size() != layers.size())
+            learnGradient = makeGradient();
+        backprop(input, targetOutput, learnGradient, inputDerivative);
+        applyGradient(learnGradient);
+        return;
+    }
+
+    // W -= rate * trans(input) * delta as a rank-1 (rank-k for batches) update straight into the
+    // weights, the delta scaled in place once the layer below no longer needs it
+    optimizer->nextStep();
+    Real_t const rate = -sgd->learningRate / sampleCount(targetOutput);
+    std::vector<Size_t> rows; // of sparse inputs, not needed here
+    backprop(
+        input, targetOutput,
+        [&](Size_t s, auto const& layerInput, auto& delta) {
+            delta *= rate;
+            addOuter(layers[s].weights, rows, layerInput, delta);
+            addBiasOuter(layers[s].biases, delta);
+            rows.clear();
+        },
+        inputDerivative);
+}
+
+void DenseNN::learn(Layer::Vec_t const& input, Layer::Vec_t const& targetOutput)
+{
+    learnImpl(input, targetOutput);
+}
+
+void DenseNN::learnEmbedded(EmbeddingLayer::Ids_t const& ids, Layer::Vec_t const& targetOutput)
+{
+    Layer::Vec_t inputDerivative;
+    learnImpl(embed(ids), targetOutput, &inputDerivative);
+    embedding->update(ids, inputDerivative);
+}
+
+template Layer::Vec_t DenseNN::forward(Layer::SparseVec_t const&) const;
+template Layer::Batch_t DenseNN::forward(Layer::Batch_t const&) const;
+template Layer::Batch_t DenseNN::forward(Layer::SparseBatch_t const&) const;
+template void DenseNN::learnImpl(Layer::SparseVec_t const&, Layer::Vec_t const&, Layer::Vec_t*);
+template void DenseNN::learnImpl(Layer::Batch_t const&, Layer::Batch_t const&, Layer::Batch_t*);
+template void DenseNN::learnImpl(Layer::SparseBatch_t const&, Layer::Batch_t const&, Layer::Batch_t*);
+template void DenseNN::accumulateGradientImpl(Layer::SparseVec_t const&, Layer::Vec_t const&, Gradient&) const;
+template void DenseNN::accumulateGradientImpl(Layer::Batch_t const&, Layer::Batch_t const&, Gradient&) const;
+template void DenseNN::accumulateGradientImpl(Layer::SparseBatch_t const&, Layer::Batch_t const&, Gradient&) const;
@@ -0,0 +1,108 @@
+#include <NumaInference.hpp>
+#include <exception>
+#include <stdexcept>
+
+namespace {
+
+Layer::Batch_t infer(std::vector<Layer> const& layers, Layer::Batch_t inputs)
+{
+    Layer::Batch_t outputs;
+    for (auto const& layer : layers) {
+        layer.infer(inputs, outputs);
+        std::swap(inputs, outputs);
+    }
+    return inputs;
+}
+
+} // namespace
+
+NumaInference::NumaInference(DenseNN const& network, Size_t workersPerNode)
+    : source(&network.getLayers())
+{
+    if (source->empty())
+        throw std::logic_error("Network has no layers");
+    inputSize = source->front().weights.rows();
+
+    for (auto& cpus : numaNodes()) {
+        nodes.push_back(std::make_unique<Node>());
+        nodes.back()->cpus = std::move(cpus);
+    }
+
+    for (auto& node : nodes) {
+        Size_t const workers = workersPerNode ? workersPerNode : node->cpus.size();
+        std::promise<void> replicaReady;
+        node->workers.emplace_back(&NumaInference::run, this, std::ref(*node), true, &replicaReady);
+        replicaReady.get_future().wait();
+        for (Size_t w = 1; w < workers; ++w)
+            node->workers.emplace_back(&NumaInference::run, this, std::ref(*node), false, nullptr);
+    }
+    source = nullptr;
+}
+
+NumaInference::~NumaInference()
+{
+    for (auto& node : nodes) {
+        for (Size_t w = 0; w < node->workers.size(); ++w)
+            node->tasks.push(std::nullopt);
+        for (auto& worker : node->workers)
+            worker.join();
+    }
+}
+
+void NumaInference::run(Node& node, bool copiesReplica, std::promise<void>* replicaReady)
+{
+    pinCurrentThread(node.cpus);
+    if (copiesReplica) {
+        node.replica = *source;
+        replicaReady->set_value();
+    }
+
+    while (auto task = node.tasks.pop())
+        (*task)(node.replica);
+}
+
+std::future<Layer::Batch_t> NumaInference::submit(Layer::Batch_t inputs)
+{
+    checkInputs(inputs);
+    auto promise = std::make_shared<std::promise<Layer::Batch_t>>();
+    auto future = promise->get_future();
+    Node& node = *nodes[nextNode++ % nodes.size()];
+    node.tasks.push(Task_t([promise, inputs = std::move(inputs)](std::vector<Layer> const& layers) mutable {
+        try {
+            promise->set_value(infer(layers, std::move(inputs)));
+        }
+        catch (...) {
+            promise->set_exception(std::current_exception());
+        }
+    }));
+    return future;
+}
+
+Layer::Batch_t NumaInference::operator()(Layer::Batch_t const& inputs)
+{
+    checkInputs(inputs);
+    Size_t const rows = inputs.rows();
+    std::vector<std::future<Layer::Batch_t>> parts;
+    for (Size_t n = 0; n < nodes.size(); ++n) {
+        Size_t const first = rows * n / nodes.size();
+        Size_t const count = rows * (n + 1) / nodes.size() - first;
+        if (count)
+            parts.push_back(submit(blaze::submatrix(inputs, first, 0, count, inputs.columns())));
+    }
+
+    Layer::Batch_t outputs;
+    Size_t row = 0;
+    for (auto& part : parts) {
+        Layer::Batch_t const values = part.get();
+        outputs.resize(rows, values.columns());
+        blaze::submatrix(outputs, row, 0, values.rows(), values.columns()) = values;
+        row += values.rows();
+    }
+    return outputs;
+}
+
+void NumaInference::checkInputs(Layer::Batch_t const& inputs) const
+{
+    if (inputs.columns() != inputSize)
+        throw std::logic_error("The inputs are not of the first layer's size");
+}
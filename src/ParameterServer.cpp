@@ -0,0 +1,351 @@
+#include <InferenceProtocol.hpp>
+#include <ParameterServer.hpp>
+#include <algorithm>
+#include <cerrno>
+#include <cmath>
+#include <cstring>
+#include <numeric>
+#include <stdexcept>
+#include <thread>
+
+#include <sys/socket.h>
+#include <unistd.h>
+
+namespace {
+
+using Clock_t = std::chrono::steady_clock;
+
+constexpr std::uint32_t Magic = 0x42505053; // "BPPS"
+
+enum Kind : std::uint32_t { Pull = 0, Push = 1, Weights = 2 };
+
+// Pull: no payload. Push: the encoded gradient of count parameters. Weights: count floats.
+struct Frame {
+    std::uint32_t magic = Magic;
+    std::uint32_t kind = Pull;
+    std::uint64_t clock = 0;    // pushes of the worker, this one included (Push)
+    std::uint64_t version = 0;  // updates behind the weights (Weights) or the gradient (Push)
+    std::uint32_t encoding = 0; // GradientCompression::Kind (Push)
+    std::uint32_t reserved = 0;
+    std::uint64_t count = 0;
+    std::uint64_t bytes = 0; // of the payload
+};
+
+template <typename T>
+void store(std::uint8_t* at, T value) { std::memcpy(at, &value, sizeof(T)); }
+
+template <typename T>
+T load(std::uint8_t const* at)
+{
+    T value;
+    std::memcpy(&value, at, sizeof(T));
+    return value;
+}
+
+} // namespace
+
+GradientEncoder::GradientEncoder(GradientCompression compression, Size_t size)
+    : compression(compression),
+      residual(size)
+{
+    if (compression.kind > GradientCompression::Int8)
+        throw std::logic_error("Unknown gradient compression");
+    if (compression.kind == GradientCompression::TopK && !(compression.topFraction > 0 && compression.topFraction <= 1))
+        throw std::logic_error("TopK keeps a fraction in (0, 1] of the values");
+}
+
+void GradientEncoder::encode(Real_t const* values, Real_t scale, std::vector<std::uint8_t>& bytes)
+{
+    // the residual becomes the corrected gradient, what is sent is taken out of it below
+    Size_t const size = residual.size();
+    for (Size_t i = 0; i < size; ++i)
+        residual[i] += values[i] * scale;
+
+    switch (compression.kind) {
+    case GradientCompression::None:
+        bytes.resize(size * sizeof(Real_t));
+        std::memcpy(bytes.data(), residual.data(), bytes.size());
+        std::fill(residual.begin(), residual.end(), Real_t(0));
+        break;
+    case GradientCompression::TopK: {
+        // (index, value) pairs in the order of the indices
+        Size_t const kept = std::clamp(Size_t(size * compression.topFraction), Size_t(1), size);
+        order.resize(size);
+        std::iota(order.begin(), order.end(), 0);
+        std::nth_element(order.begin(), order.begin() + kept - 1, order.end(),
+                         [&](std::uint32_t a, std::uint32_t b) { return std::abs(residual[a]) > std::abs(residual[b]); });
+        std::sort(order.begin(), order.begin() + kept);
+        bytes.resize(kept * (sizeof(std::uint32_t) + sizeof(Real_t)));
+        std::uint8_t* out = bytes.data();
+        for (Size_t k = 0; k < kept; ++k, out += sizeof(std::uint32_t) + sizeof(Real_t)) {
+            store(out, order[k]);
+            store(out + sizeof(std::uint32_t), residual[order[k]]);
+            residual[order[k]] = 0;
+        }
+        break;
+    }
+    case GradientCompression::Int8: {
+        // the scale of every block, then a byte of every value
+        Size_t const blocks = (size + GradientCompression::Int8Block - 1) / GradientCompression::Int8Block;
+        bytes.resize(blocks * sizeof(Real_t) + size);
+        auto* quantized = reinterpret_cast<std::int8_t*>(bytes.data() + blocks * sizeof(Real_t));
+        for (Size_t b = 0; b < blocks; ++b) {
+            Size_t const begin = b * GradientCompression::Int8Block;
+            Size_t const end = std::min(size, begin + GradientCompression::Int8Block);
+            Real_t largest = 0;
+            for (Size_t i = begin; i < end; ++i)
+                largest = std::max(largest, std::abs(residual[i]));
+            Real_t const step = largest / 127;
+            store(bytes.data() + b * sizeof(Real_t), step);
+            for (Size_t i = begin; i < end; ++i) {
+                auto const q = step > 0 ? std::int8_t(std::lround(residual[i] / step)) : std::int8_t(0);
+                quantized[i] = q;
+                residual[i] -= q * step;
+            }
+        }
+        break;
+    }
+    }
+}
+
+bool GradientEncoder::sizeMatches(GradientCompression::Kind kind, Size_t bytes, Size_t size)
+{
+    Size_t constexpr pair = sizeof(std::uint32_t) + sizeof(Real_t);
+    switch (kind) {
+    case GradientCompression::None:
+        return bytes == size * sizeof(Real_t);
+    case GradientCompression::TopK:
+        return bytes && bytes % pair == 0 && bytes <= size * pair;
+    case GradientCompression::Int8:
+        return bytes == (size + GradientCompression::Int8Block - 1) / GradientCompression::Int8Block * sizeof(Real_t) + size;
+    }
+    return false;
+}
+
+bool GradientEncoder::decode(GradientCompression::Kind kind, std::vector<std::uint8_t> const& bytes, Real_t* values, Size_t size)
+{
+    if (!sizeMatches(kind, bytes.size(), size))
+        return false;
+    switch (kind) {
+    case GradientCompression::None:
+        for (Size_t i = 0; i < size; ++i)
+            values[i] += load<Real_t>(bytes.data() + i * sizeof(Real_t));
+        return true;
+    case GradientCompression::TopK:
+        for (std::uint8_t const* in = bytes.data(); in != bytes.data() + bytes.size(); in += sizeof(std::uint32_t) + sizeof(Real_t)) {
+            auto const index = load<std::uint32_t>(in);
+            if (index >= size)
+                return false;
+            values[index] += load<Real_t>(in + sizeof(std::uint32_t));
+        }
+        return true;
+    case GradientCompression::Int8: {
+        Size_t const blocks = (size + GradientCompression::Int8Block - 1) / GradientCompression::Int8Block;
+        auto const* quantized = reinterpret_cast<std::int8_t const*>(bytes.data() + blocks * sizeof(Real_t));
+        for (Size_t b = 0; b < blocks; ++b) {
+            Real_t const step = load<Real_t>(bytes.data() + b * sizeof(Real_t));
+            Size_t const begin = b * GradientCompression::Int8Block;
+            Size_t const end = std::min(size, begin + GradientCompression::Int8Block);
+            for (Size_t i = begin; i < end; ++i)
+                values[i] += quantized[i] * step;
+        }
+        return true;
+    }
+    }
+    return false;
+}
+
+ParameterServer::ParameterServer(DenseNN network, std::string const& path, Options options)
+    : path(path),
+      options(options),
+      network(std::move(network)),
+      clocks(options.workers),
+      left(options.workers)
+{
+    if (!options.workers)
+        throw std::logic_error("A parameter server needs at least one worker");
+    listener = protocol::listenUnix(path);
+}
+
+ParameterServer::~ParameterServer()
+{
+    ::close(listener);
+    ::unlink(path.c_str());
+}
+
+void ParameterServer::run()
+{
+    std::vector<std::thread> threads;
+    while (threads.size() < options.workers) {
+        int const fd = ::accept(listener, nullptr, nullptr);
+        if (fd >= 0) {
+            threads.emplace_back(&ParameterServer::serve, this, threads.size(), fd);
+            continue;
+        }
+        if (errno == EINTR)
+            continue;
+
+        // the connected workers are served to the end, the missing ones no longer hold them back
+        int const error = errno;
+        for (Size_t missing = threads.size(); missing < options.workers; ++missing)
+            leave(missing);
+        for (auto& thread : threads)
+            thread.join();
+        throw std::runtime_error(std::string("accept: ") + std::strerror(error));
+    }
+    for (auto& thread : threads)
+        thread.join();
+}
+
+DenseNN ParameterServer::model() const
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return network;
+}
+
+ParameterServer::Stats ParameterServer::stats() const
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return counters;
+}
+
+Size_t ParameterServer::slowestClock() const
+{
+    Size_t slowest = Size_t(-1);
+    for (Size_t worker = 0; worker < clocks.size(); ++worker)
+        if (!left[worker])
+            slowest = std::min(slowest, clocks[worker]);
+    return slowest;
+}
+
+void ParameterServer::leave(Size_t worker)
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        left[worker] = true;
+    }
+    advanced.notify_all();
+}
+
+void ParameterServer::serve(Size_t worker, int fd)
+{
+    DenseNN::Gradient gradient;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        gradient = network.makeGradient();
+    }
+
+    Frame frame;
+    std::vector<std::uint8_t> payload;
+    while (protocol::readAll(fd, &frame, sizeof(frame)) && frame.magic == Magic) {
+        if (frame.kind == Pull) {
+            ParameterArena parameters;
+            Frame reply;
+            reply.kind = Weights;
+            {
+                auto const start = Clock_t::now();
+                std::unique_lock<std::mutex> lock(mutex);
+                advanced.wait(lock, [&] { return clocks[worker] <= slowestClock() + options.staleness; });
+                counters.heldSeconds += std::chrono::duration<double>(Clock_t::now() - start).count();
+                ++counters.pulls;
+                parameters = network.parameters();
+                reply.version = version;
+            }
+            reply.count = parameters.size();
+            reply.bytes = parameters.size() * sizeof(Real_t);
+            if (!protocol::writeAll(fd, &reply, sizeof(reply)) || !protocol::writeAll(fd, parameters.data(), reply.bytes))
+                break;
+        }
+        else if (frame.kind == Push) {
+            // the size is checked before it is allocated, a header cannot ask for more than its encoding
+            if (frame.count != gradient.size() ||
+                !GradientEncoder::sizeMatches(GradientCompression::Kind(frame.encoding), frame.bytes, frame.count))
+                break;
+            payload.resize(frame.bytes);
+            if (!protocol::readAll(fd, payload.data(), payload.size()) ||
+                !GradientEncoder::decode(GradientCompression::Kind(frame.encoding), payload, gradient.data(), gradient.size()))
+                break;
+            // the pushes are means over the samples of the worker
+            gradient.samples = 1;
+            gradient.denseInput = true;
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                counters.maxStaleness = std::max(counters.maxStaleness, Size_t(version - std::min<Size_t>(version, frame.version)));
+                network.applyGradient(gradient);
+                ++version;
+                clocks[worker] = std::max(clocks[worker], Size_t(frame.clock));
+                ++counters.pushes;
+                counters.gradientBytes += frame.bytes;
+                counters.denseBytes += frame.count * sizeof(Real_t);
+            }
+            advanced.notify_all();
+        }
+        else
+            break;
+    }
+    ::close(fd);
+    leave(worker);
+}
+
+ParameterClient::ParameterClient(std::string const& path, GradientCompression compression, std::chrono::milliseconds timeout)
+    : compression(compression)
+{
+    auto const deadline = Clock_t::now() + timeout;
+    while (fd < 0)
+        try {
+            fd = protocol::connectUnix(path);
+        }
+        catch (std::runtime_error const&) {
+            if (Clock_t::now() > deadline)
+                throw;
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+}
+
+ParameterClient::~ParameterClient() { ::close(fd); }
+
+void ParameterClient::pull(DenseNN& network)
+{
+    Frame request;
+    request.kind = Pull;
+    if (!protocol::writeAll(fd, &request, sizeof(request)))
+        throw std::runtime_error("The parameter server is gone");
+
+    Frame reply;
+    ParameterArena parameters = network.parameters();
+    if (!protocol::readAll(fd, &reply, sizeof(reply)) || reply.magic != Magic || reply.kind != Weights)
+        throw std::runtime_error("The parameter server is gone");
+    if (reply.count != parameters.size() || reply.bytes != reply.count * sizeof(Real_t))
+        throw std::logic_error("The network is not shaped like the one of the parameter server");
+    if (!protocol::readAll(fd, parameters.data(), reply.bytes))
+        throw std::runtime_error("The parameter server is gone");
+    network.setParameters(parameters);
+    version = reply.version;
+}
+
+void ParameterClient::push(DenseNN::Gradient& gradient)
+{
+    if (!gradient.samples)
+        return;
+    if (!encoder)
+        encoder.emplace(compression, gradient.size());
+    if (encoder->size() != gradient.size())
+        throw std::logic_error("The gradient is not shaped like the earlier ones");
+
+    encoder->encode(gradient.data(), Real_t(1) / gradient.samples, message);
+    Frame frame;
+    frame.kind = Push;
+    frame.clock = ++pushes;
+    frame.version = version;
+    frame.encoding = compression.kind;
+    frame.count = gradient.size();
+    frame.bytes = message.size();
+    if (!protocol::writeAll(fd, &frame, sizeof(frame)) || !protocol::writeAll(fd, message.data(), message.size()))
+        throw std::runtime_error("The parameter server is gone");
+    sent += message.size();
+
+    std::fill(gradient.data(), gradient.data() + gradient.size(), Real_t(0));
+    gradient.inputRows.clear();
+    gradient.denseInput = false;
+    gradient.samples = 0;
+}
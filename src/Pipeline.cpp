@@ -0,0 +1,221 @@
+#include <Gemm.hpp>
+#include <Pipeline.hpp>
+#include <algorithm>
+#include <chrono>
+#include <exception>
+
+namespace {
+
+double secondsSince(std::chrono::steady_clock::time_point start)
+{
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+} // namespace
+
+PipelineTrainer::PipelineTrainer(DenseNN& network, Size_t stageCount)
+    : network(network),
+      gradient(network.makeGradient())
+{
+    auto const& layers = network.layers;
+    if (network.embedding)
+        throw std::logic_error("Pipelined networks cannot have an embedding stage");
+    stageCount = std::max<Size_t>(1, std::min(stageCount, layers.size()));
+
+    Size_t total = 0;
+    for (auto const& layer : layers)
+        total += layer.weights.rows() * layer.weights.columns();
+
+    // greedy split, every stage takes layers until it holds its share of the weights
+    Size_t begin = 0;
+    Size_t assigned = 0;
+    for (Size_t i = 0; i < stageCount; ++i) {
+        Size_t end = begin + 1;
+        assigned += layers[begin].weights.rows() * layers[begin].weights.columns();
+        while (layers.size() - end > stageCount - i - 1 && assigned < total * (i + 1) / stageCount) {
+            assigned += layers[end].weights.rows() * layers[end].weights.columns();
+            ++end;
+        }
+        if (i == stageCount - 1)
+            end = layers.size();
+
+        stages.push_back(std::make_unique<Stage>());
+        stages.back()->begin = begin;
+        stages.back()->end = end;
+        begin = end;
+    }
+
+    for (Size_t i = 0; i < stages.size(); ++i)
+        stages[i]->thread = std::thread(&PipelineTrainer::run, this, i);
+}
+
+PipelineTrainer::~PipelineTrainer()
+{
+    for (auto& stage : stages) {
+        stage->inbox.push(std::nullopt);
+        stage->thread.join();
+    }
+}
+
+void PipelineTrainer::learn(Layer::Batch_t const& inputs, Layer::Batch_t const& targets, Size_t microBatches)
+{
+    if (network.linearOutputLoss && network.layers.back().activFn)
+        throw std::logic_error("The loss needs a linear output layer");
+    if (inputs.columns() != network.layers.front().weights.rows())
+        throw std::logic_error("The inputs are not of the first layer's size");
+    network.checkTargets(inputs.rows(), targets.rows(), targets.columns());
+
+    auto const start = std::chrono::steady_clock::now();
+    Size_t const rows = inputs.rows();
+    microBatches = std::max<Size_t>(1, std::min(microBatches, rows));
+
+    this->targets = &targets;
+    microBatchRows.clear();
+    for (Size_t m = 0; m <= microBatches; ++m)
+        microBatchRows.push_back(rows * m / microBatches);
+    for (auto& stage : stages) {
+        stage->inputs.resize(microBatches);
+        stage->activations.resize(microBatches);
+    }
+
+    for (Size_t m = 0; m < microBatches; ++m) {
+        Size_t const first = microBatchRows[m];
+        Size_t const count = microBatchRows[m + 1] - first;
+        stages.front()->inbox.push(Message{ false, m, blaze::submatrix(inputs, first, 0, count, inputs.columns()) });
+    }
+    // every stage but the last handles a forward and a backward message per micro-batch, the last
+    // one turns its forward messages around itself; once all of them are handled the stages are idle
+    // and their busy time is complete
+    std::exception_ptr failure;
+    for (Size_t i = 0; i < microBatches * (2 * stages.size() - 1); ++i)
+        if (auto error = handled.pop(); error && !failure)
+            failure = error;
+    if (failure) {
+        std::fill(gradient.data(), gradient.data() + gradient.size(), Real_t(0));
+        wallSeconds += secondsSince(start);
+        std::rethrow_exception(failure);
+    }
+
+    gradient.samples = rows;
+    gradient.denseInput = true;
+    network.applyGradient(gradient);
+    wallSeconds += secondsSince(start);
+}
+
+void PipelineTrainer::run(Size_t index)
+{
+    pinCurrentThread(index);
+    Stage& stage = *stages[index];
+
+    while (auto message = stage.inbox.pop()) {
+        auto const start = std::chrono::steady_clock::now();
+        std::exception_ptr error = message->error;
+        if (!error)
+            try {
+                if (message->backward)
+                    backward(stage, message->microBatch, std::move(message->values));
+                else
+                    forward(stage, *message);
+            }
+            catch (...) {
+                error = std::current_exception();
+            }
+        if (error)
+            passOn(stage, *message, error);
+        stage.busySeconds += secondsSince(start);
+        handled.push(error);
+    }
+}
+
+// a failed micro-batch still takes the path of its messages, so every stage handles as many as
+// learn() waits for
+void PipelineTrainer::passOn(Stage& stage, Message const& message, std::exception_ptr error)
+{
+    stage.activations[message.microBatch].clear();
+    stage.inputs[message.microBatch] = Layer::Batch_t();
+    if (!message.backward && stage.end < network.layers.size()) {
+        Stage& next = **std::find_if(stages.begin(), stages.end(), [&](auto const& s) { return s->begin == stage.end; });
+        next.inbox.push(Message{ false, message.microBatch, {}, error });
+    }
+    else if (stage.begin) {
+        Stage& previous = **std::find_if(stages.begin(), stages.end(), [&](auto const& s) { return s->end == stage.begin; });
+        previous.inbox.push(Message{ true, message.microBatch, {}, error });
+    }
+}
+
+void PipelineTrainer::forward(Stage& stage, Message& message)
+{
+    auto const& layers = network.layers;
+    Size_t const m = message.microBatch;
+    auto& activations = stage.activations[m];
+    stage.inputs[m] = std::move(message.values);
+
+    activations.resize(stage.end - stage.begin);
+    activations.front() = layers[stage.begin].eval(stage.inputs[m]);
+    for (Size_t s = stage.begin + 1; s < stage.end; ++s)
+        activations[s - stage.begin] = layers[s].eval(activations[s - stage.begin - 1].first);
+
+    if (stage.end < layers.size()) {
+        Stage& next = **std::find_if(stages.begin(), stages.end(), [&](auto const& s) { return s->begin == stage.end; });
+        next.inbox.push(Message{ false, m, activations.back().first });
+        return;
+    }
+
+    // the last stage turns around right away, its upstream derivative is the loss delta itself
+    auto const& [fz, z] = activations.back();
+    Layer::Batch_t delta(z.rows(), z.columns());
+    Size_t const first = microBatchRows[m];
+    for (Size_t i = 0; i < z.rows(); ++i)
+        network.lossDeltaFn(layers.back(), z.data(i), fz.data(i), targets->data(first + i), delta.data(i), z.columns());
+    backward(stage, m, std::move(delta));
+}
+
+// upstream holds dE/df(z) of the stage's last layer, or the loss delta for the last stage
+void PipelineTrainer::backward(Stage& stage, Size_t microBatch, Layer::Batch_t upstream)
+{
+    auto const& layers = network.layers;
+    auto& activations = stage.activations[microBatch];
+
+    Layer::Batch_t delta;
+    for (Size_t s = stage.end; s-- > stage.begin;) {
+        auto const& z = activations[s - stage.begin].second;
+        if (s != layers.size() - 1)
+            layers[s].multiplyDerivZ(z, upstream);
+        std::swap(delta, upstream);
+
+        auto const& input = s == stage.begin ? stage.inputs[microBatch] : activations[s - stage.begin - 1].first;
+        gemm(input, true, delta, false, gradient.weights[s], 1);
+        gradient.biases[s] += blaze::sum<blaze::columnwise>(delta);
+        if (s)
+            gemm(delta, false, layers[s].weights, true, upstream);
+    }
+    activations.clear();
+    stage.inputs[microBatch] = Layer::Batch_t();
+
+    if (stage.begin) {
+        Stage& previous = **std::find_if(stages.begin(), stages.end(), [&](auto const& s) { return s->end == stage.begin; });
+        previous.inbox.push(Message{ true, microBatch, std::move(upstream) });
+    }
+}
+
+PipelineTrainer::Report PipelineTrainer::report() const
+{
+    Report report;
+    double busy = 0;
+    for (auto const& stage : stages) {
+        report.stageUtilization.push_back(wallSeconds ? Real_t(stage->busySeconds / wallSeconds) : 0);
+        busy += stage->busySeconds;
+    }
+    if (wallSeconds)
+        report.bubbleFraction = Real_t(1 - busy / (wallSeconds * stages.size()));
+    return report;
+}
+
+std::vector<Size_t> PipelineTrainer::stageBoundaries() const
+{
+    std::vector<Size_t> boundaries;
+    for (auto const& stage : stages)
+        boundaries.push_back(stage->begin);
+    boundaries.push_back(network.layers.size());
+    return boundaries;
+}
@@ -0,0 +1,219 @@
+#include <SharedModel.hpp>
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <utility>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace {
+
+// the mapping: a Header, layerCount LayerHeaders, then the weights and biases of every layer at
+// 64 byte aligned offsets, each row of weights padded with zeros to a multiple of 64 bytes
+constexpr Size_t Alignment = 64;
+constexpr Size_t RowFloats = Alignment / sizeof(Real_t);
+char const mappingMagic[8] = { 'B', 'P', 'S', 'H', 'A', 'R', 'E', '1' };
+
+struct Header {
+    char magic[8];
+    std::uint64_t bytes;
+    std::uint64_t layerCount;
+};
+
+struct LayerHeader {
+    std::uint64_t rows;
+    std::uint64_t columns;
+    std::uint64_t spacing;
+    std::uint64_t weightsOffset;
+    std::uint64_t biasesOffset;
+    char activation[16];
+};
+
+Size_t alignUp(Size_t value) { return (value + Alignment - 1) / Alignment * Alignment; }
+
+std::string objectName(std::string const& name)
+{
+    if (name.empty() || name.find('/') != std::string::npos)
+        throw std::logic_error("Model names cannot be empty or contain '/'");
+    return "/backprop." + name;
+}
+
+[[noreturn]] void fail(std::string const& what, std::string const& name)
+{
+    throw std::runtime_error(what + " " + name + ": " + std::strerror(errno));
+}
+
+} // namespace
+
+void SharedModel::publish(std::string const& name, DenseNN const& network)
+{
+    auto const& source = network.getLayers();
+    if (source.empty())
+        throw std::logic_error("Network has no layers");
+
+    std::vector<LayerHeader> headers(source.size());
+    Size_t bytes = alignUp(sizeof(Header) + headers.size() * sizeof(LayerHeader));
+    for (Size_t s = 0; s < source.size(); ++s) {
+        char const* const activation = Layer::activationName(source[s].activFn);
+        if (!activation)
+            throw std::logic_error("The activation of a layer has no saved name");
+
+        LayerHeader& header = headers[s];
+        header = LayerHeader{};
+        header.rows = source[s].weights.rows();
+        header.columns = source[s].weights.columns();
+        header.spacing = (header.columns + RowFloats - 1) / RowFloats * RowFloats;
+        std::strncpy(header.activation, activation, sizeof(header.activation) - 1);
+        header.weightsOffset = bytes;
+        bytes = alignUp(bytes + header.rows * header.spacing * sizeof(Real_t));
+        header.biasesOffset = bytes;
+        bytes = alignUp(bytes + header.spacing * sizeof(Real_t));
+    }
+
+    // a new object under the name, the old one lives on in the processes that mapped it
+    std::string const object = objectName(name);
+    ::shm_unlink(object.c_str());
+    int const fd = ::shm_open(object.c_str(), O_CREAT | O_EXCL | O_RDWR, 0644);
+    if (fd < 0)
+        fail("Could not create the shared model", name);
+    if (::ftruncate(fd, bytes)) {
+        ::close(fd);
+        ::shm_unlink(object.c_str());
+        fail("Could not size the shared model", name);
+    }
+    void* const mapping = ::mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if (mapping == MAP_FAILED) {
+        ::shm_unlink(object.c_str());
+        fail("Could not map the shared model", name);
+    }
+
+    // ftruncate zeroed the object, so the padding is already zero
+    char* const base = static_cast<char*>(mapping);
+    for (Size_t s = 0; s < source.size(); ++s) {
+        LayerHeader const& header = headers[s];
+        auto* const weights = reinterpret_cast<Real_t*>(base + header.weightsOffset);
+        for (Size_t i = 0; i < header.rows; ++i)
+            std::copy(source[s].weights.data(i), source[s].weights.data(i) + header.columns, weights + i * header.spacing);
+        std::copy(source[s].biases.begin(), source[s].biases.end(), reinterpret_cast<Real_t*>(base + header.biasesOffset));
+    }
+    std::memcpy(base + sizeof(Header), headers.data(), headers.size() * sizeof(LayerHeader));
+
+    // the magic goes last, a model is only opened once it is complete
+    Header header{ {}, bytes, headers.size() };
+    std::memcpy(base + sizeof(header.magic), &header.bytes, sizeof(Header) - sizeof(header.magic));
+    std::atomic_thread_fence(std::memory_order_release);
+    std::memcpy(base, mappingMagic, sizeof(mappingMagic));
+    ::munmap(mapping, bytes);
+}
+
+void SharedModel::remove(std::string const& name)
+{
+    if (::shm_unlink(objectName(name).c_str()) && errno != ENOENT)
+        fail("Could not remove the shared model", name);
+}
+
+SharedModel SharedModel::open(std::string const& name)
+{
+    int const fd = ::shm_open(objectName(name).c_str(), O_RDONLY, 0);
+    if (fd < 0)
+        fail("Could not open the shared model", name);
+    struct stat status;
+    if (::fstat(fd, &status)) {
+        ::close(fd);
+        fail("Could not open the shared model", name);
+    }
+    void* const mapping = ::mmap(nullptr, status.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if (mapping == MAP_FAILED)
+        fail("Could not map the shared model", name);
+
+    SharedModel model(mapping, status.st_size);
+    Header header;
+    std::memcpy(&header, mapping, std::min<Size_t>(sizeof(header), status.st_size));
+    if (Size_t(status.st_size) < sizeof(Header) || std::memcmp(header.magic, mappingMagic, sizeof(mappingMagic)) ||
+        header.bytes != Size_t(status.st_size) || !header.layerCount ||
+        header.layerCount > (header.bytes - sizeof(Header)) / sizeof(LayerHeader))
+        throw std::runtime_error("The shared model " + name + " is incomplete or not a model");
+    std::atomic_thread_fence(std::memory_order_acquire);
+
+    // every view has to lie within the mapping, aligned, and fit the layer before it
+    auto const fits = [&header](std::uint64_t offset, std::uint64_t rows, std::uint64_t spacing) {
+        return offset % Alignment == 0 && offset <= header.bytes && spacing <= header.bytes &&
+               (!spacing || rows <= (header.bytes - offset) / (spacing * sizeof(Real_t)));
+    };
+    char* const base = static_cast<char*>(mapping);
+    for (Size_t s = 0; s < header.layerCount; ++s) {
+        LayerHeader layer;
+        std::memcpy(&layer, base + sizeof(Header) + s * sizeof(LayerHeader), sizeof(layer));
+        layer.activation[sizeof(layer.activation) - 1] = 0;
+
+        if (!layer.rows || layer.spacing % RowFloats || layer.spacing < layer.columns ||
+            !fits(layer.weightsOffset, layer.rows, layer.spacing) || !fits(layer.biasesOffset, 1, layer.columns) ||
+            (s && layer.rows != model.layers.back().weights.columns()))
+            throw std::runtime_error("The shared model " + name + " has a layer outside of its mapping or of a mismatched size");
+        Layer::ActivFn_t activFn, activFnDeriv;
+        if (!Layer::activationFns(layer.activation, activFn, activFnDeriv))
+            throw std::runtime_error("The shared model " + name + " uses the unknown activation " + layer.activation);
+        model.layers.push_back(LayerView{ WeightsView_t(reinterpret_cast<Real_t*>(base + layer.weightsOffset), layer.rows, layer.columns, layer.spacing),
+                                          BiasesView_t(reinterpret_cast<Real_t*>(base + layer.biasesOffset), layer.columns),
+                                          activFn });
+    }
+    return model;
+}
+
+SharedModel::SharedModel(void* mapping, Size_t size)
+    : mapping(mapping),
+      size(size)
+{
+}
+
+SharedModel::SharedModel(SharedModel&& other)
+    : mapping(std::exchange(other.mapping, nullptr)),
+      size(std::exchange(other.size, 0)),
+      layers(std::move(other.layers))
+{
+}
+
+SharedModel& SharedModel::operator=(SharedModel&& other)
+{
+    std::swap(mapping, other.mapping);
+    std::swap(size, other.size);
+    std::swap(layers, other.layers);
+    return *this;
+}
+
+SharedModel::~SharedModel()
+{
+    if (mapping)
+        ::munmap(mapping, size);
+}
+
+Layer::Vec_t SharedModel::operator()(Layer::Vec_t const& input) const
+{
+    Layer::Vec_t output = input;
+    for (auto const& layer : layers) {
+        output = output * layer.weights + layer.biases;
+        if (layer.activFn)
+            output = blaze::map(output, [&layer](Real_t z) { return layer.activFn(z); });
+    }
+    return output;
+}
+
+Layer::Batch_t SharedModel::operator()(Layer::Batch_t const& inputs) const
+{
+    Layer::Batch_t outputs = inputs;
+    for (auto const& layer : layers) {
+        outputs = outputs * layer.weights;
+        outputs += blaze::expand(layer.biases, outputs.rows());
+        if (layer.activFn)
+            outputs = blaze::map(outputs, [&layer](Real_t z) { return layer.activFn(z); });
+    }
+    return outputs;
+}
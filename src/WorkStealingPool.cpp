@@ -0,0 +1,176 @@
+#include <WorkStealingPool.hpp>
+#include <algorithm>
+
+namespace {
+
+// rounds of looking for tasks before an idle worker parks, a few microseconds, when every worker
+// has a core of its own; on more workers than cores spinning only keeps the busy ones off theirs
+constexpr std::size_t SpinRounds = 256;
+
+// the pool and index of the worker running on this thread
+thread_local WorkStealingPool const* currentPool = nullptr;
+thread_local std::size_t currentWorker = 0;
+
+void relax()
+{
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_ia32_pause();
+#else
+    std::this_thread::yield();
+#endif
+}
+
+} // namespace
+
+WorkStealingPool::WorkStealingPool(std::size_t threads) { start(threads); }
+
+WorkStealingPool::~WorkStealingPool()
+{
+    wait();
+    stop();
+}
+
+void WorkStealingPool::resize(std::size_t threads, bool)
+{
+    if (threads == size())
+        return;
+    wait();
+    stop();
+    start(threads);
+}
+
+void WorkStealingPool::start(std::size_t threads)
+{
+    stopping = false;
+    workers.resize(std::max<std::size_t>(threads, 1));
+    spinRounds = workers.size() <= std::thread::hardware_concurrency() ? SpinRounds : 0;
+    for (auto& worker : workers)
+        worker = std::make_unique<Worker>();
+    // the threads only start once every deque exists, they steal from each other
+    for (std::size_t i = 0; i < workers.size(); ++i)
+        workers[i]->thread = std::thread(&WorkStealingPool::work, this, i);
+}
+
+void WorkStealingPool::stop()
+{
+    {
+        std::lock_guard<std::mutex> lock(parking);
+        stopping = true;
+    }
+    wakeUp.notify_all();
+    for (auto& worker : workers)
+        worker->thread.join();
+    workers.clear();
+}
+
+void WorkStealingPool::push(Task* task)
+{
+    // counted before they can be taken, so the counters never go below zero
+    unfinished.fetch_add(1, std::memory_order_relaxed);
+    queued.fetch_add(1, std::memory_order_seq_cst);
+
+    if (currentPool == this)
+        workers[currentWorker]->tasks.push(task);
+    else {
+        task->next = injected.load(std::memory_order_relaxed);
+        while (!injected.compare_exchange_weak(task->next, task, std::memory_order_release, std::memory_order_relaxed))
+            ;
+    }
+
+    // a worker about to park sees queued above zero, one already parked is woken under the lock
+    if (sleepers.load(std::memory_order_seq_cst)) {
+        std::lock_guard<std::mutex> lock(parking);
+        wakeUp.notify_one();
+    }
+}
+
+WorkStealingPool::Task* WorkStealingPool::find(std::size_t self)
+{
+    Worker& worker = *workers[self];
+    if (Task* task = worker.tasks.pop())
+        return task;
+
+    // the stack of tasks from outside is taken whole (no ABA), the oldest task runs first and the
+    // others wait in the deque, where the other workers can steal them
+    if (injected.load(std::memory_order_relaxed))
+        if (Task* stack = injected.exchange(nullptr, std::memory_order_acquire)) {
+            Task* oldest = nullptr;
+            for (Task* next; stack; stack = next) {
+                next = stack->next;
+                if (oldest)
+                    worker.tasks.push(oldest);
+                oldest = stack;
+            }
+            return oldest;
+        }
+
+    return steal(self + 1);
+}
+
+WorkStealingPool::Task* WorkStealingPool::steal(std::size_t first)
+{
+    for (std::size_t i = 0; i < workers.size(); ++i)
+        if (Task* task = workers[(first + i) % workers.size()]->tasks.steal())
+            return task;
+    return nullptr;
+}
+
+void WorkStealingPool::run(Task* task)
+{
+    queued.fetch_sub(1, std::memory_order_relaxed);
+    task->run();
+    delete task;
+
+    if (unfinished.fetch_sub(1, std::memory_order_seq_cst) == 1 && waiters.load(std::memory_order_seq_cst)) {
+        std::lock_guard<std::mutex> lock(parking);
+        finished.notify_all();
+    }
+}
+
+void WorkStealingPool::work(std::size_t self)
+{
+    currentPool = this;
+    currentWorker = self;
+
+    for (std::size_t spins = 0;;) {
+        if (Task* task = find(self)) {
+            run(task);
+            spins = 0;
+            continue;
+        }
+        if (spins++ < spinRounds) {
+            relax();
+            continue;
+        }
+
+        sleepers.fetch_add(1, std::memory_order_seq_cst);
+        {
+            std::unique_lock<std::mutex> lock(parking);
+            wakeUp.wait(lock, [this] { return queued.load(std::memory_order_seq_cst) || stopping; });
+        }
+        sleepers.fetch_sub(1, std::memory_order_relaxed);
+        if (stopping && !queued.load())
+            return;
+        spins = 0;
+    }
+}
+
+void WorkStealingPool::wait()
+{
+    // the caller helps with the tasks it can steal, the stack from outside is left to the workers
+    for (std::size_t spins = 0; unfinished.load(std::memory_order_acquire);) {
+        if (Task* task = steal(0)) {
+            run(task);
+            spins = 0;
+        } else if (spins++ < spinRounds)
+            relax();
+        else {
+            waiters.fetch_add(1, std::memory_order_seq_cst);
+            {
+                std::unique_lock<std::mutex> lock(parking);
+                finished.wait(lock, [this] { return !unfinished.load(std::memory_order_seq_cst); });
+            }
+            waiters.fetch_sub(1, std::memory_order_relaxed);
+        }
+    }
+}
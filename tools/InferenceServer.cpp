@@ -0,0 +1,242 @@
+#include <BatchScheduler.hpp>
+#include <InferenceProtocol.hpp>
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <exception>
+#include <memory>
+#include <string>
+
+#include <sys/socket.h>
+#include <unistd.h>
+
+// Serves a saved DenseNN (or a random one, "random:2,16,16,2") over a Unix-domain socket:
+//   inference-server <socket> <model> [--max-rows N] [--max-delay-us T] [--workers W]
+// Prints the throughput and the p50/p99 latency from arrival to response every second, and the
+// totals on SIGINT or SIGTERM. SIGHUP reloads the model file and swaps it in without pausing.
+
+namespace {
+
+using Clock_t = BatchScheduler::Clock_t;
+
+// counts of latencies in buckets 1/64 of an octave wide from 1/8 us up to about 60 s, percentiles
+// are read to within about 1% and the memory stays fixed however long the server runs
+class LatencyHistogram {
+public:
+    void add(double micros)
+    {
+        ++counts[bucket(micros)];
+        ++count;
+    }
+
+    double percentile(double p) const
+    {
+        if (!count)
+            return 0;
+        Size_t const rank = Size_t(p * (count - 1));
+        Size_t seen = 0;
+        for (Size_t i = 0; i < Buckets; ++i)
+            if ((seen += counts[i]) > rank)
+                return std::exp2((i + 0.5) / PerOctave) * Smallest;
+        return std::exp2(double(Buckets) / PerOctave) * Smallest;
+    }
+
+private:
+    static constexpr Size_t PerOctave = 64;
+    static constexpr Size_t Buckets = 29 * PerOctave;
+    static constexpr double Smallest = 0.125;
+
+    static Size_t bucket(double micros)
+    {
+        double const octaves = std::log2(std::max(micros, Smallest) / Smallest);
+        return std::min(Buckets - 1, Size_t(octaves * PerOctave));
+    }
+
+    std::array<Size_t, Buckets> counts{};
+    Size_t count = 0;
+};
+
+// latencies of the answered requests, per reporting interval and in total
+class LatencyLog {
+public:
+    void add(double micros, bool missed)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        (missed ? intervalMissed : intervalOk) += 1;
+        if (!missed)
+            interval.push_back(micros);
+    }
+
+    void report(double seconds, bool final)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        for (double micros : interval)
+            all.add(micros);
+        totalOk += intervalOk;
+        totalMissed += intervalMissed;
+        Size_t const ok = final ? totalOk : intervalOk;
+        Size_t const missed = final ? totalMissed : intervalMissed;
+        if (ok + missed) {
+            double const p50 = final ? all.percentile(0.5) : percentile(interval, 0.5);
+            double const p99 = final ? all.percentile(0.99) : percentile(interval, 0.99);
+            std::printf("%s%10.0f req/s  p50 %9.1f us  p99 %9.1f us  missed %zu\n", final ? "total " : "", ok / seconds, p50, p99,
+                        missed);
+        }
+        std::fflush(stdout);
+        interval.clear();
+        intervalOk = intervalMissed = 0;
+    }
+
+private:
+    static double percentile(std::vector<double>& values, double p)
+    {
+        if (values.empty())
+            return 0;
+        auto nth = values.begin() + Size_t(p * (values.size() - 1));
+        std::nth_element(values.begin(), nth, values.end());
+        return *nth;
+    }
+
+    std::mutex mutex;
+    std::vector<double> interval;
+    LatencyHistogram all;
+    Size_t intervalOk = 0, intervalMissed = 0, totalOk = 0, totalMissed = 0;
+};
+
+struct Connection {
+    int fd = -1;
+    std::mutex writing; // responses come from every worker
+
+    ~Connection() { ::close(fd); }
+};
+
+bool deadlineMissed(std::exception_ptr error)
+{
+    try {
+        std::rethrow_exception(error);
+    }
+    catch (DeadlineMissed const&) {
+        return true;
+    }
+    catch (...) {
+        return false;
+    }
+}
+
+void serve(std::shared_ptr<Connection> connection, BatchScheduler& scheduler, LatencyLog& log)
+{
+    protocol::RequestHeader request;
+    std::vector<Real_t> values;
+    while (protocol::readRequest(connection->fd, request, values)) {
+        auto const arrival = Clock_t::now();
+        auto const respond = [connection, &log, arrival, id = request.id](protocol::Status status, Layer::Vec_t const* output) {
+            protocol::ResponseHeader response;
+            response.id = id;
+            response.status = status;
+            response.size = output ? output->size() : 0;
+            {
+                std::lock_guard<std::mutex> lock(connection->writing);
+                protocol::writeResponse(connection->fd, response, output ? output->data() : nullptr);
+            }
+            if (status == protocol::Ok || status == protocol::DeadlineMissed)
+                log.add(std::chrono::duration<double, std::micro>(Clock_t::now() - arrival).count(), status == protocol::DeadlineMissed);
+        };
+
+        if (values.size() != scheduler.inputSize()) {
+            respond(protocol::BadRequest, nullptr);
+            continue;
+        }
+        Layer::Vec_t input(values.size());
+        std::copy(values.begin(), values.end(), input.begin());
+        auto const deadline = request.budgetMicros ? arrival + std::chrono::microseconds(request.budgetMicros) : Clock_t::time_point::max();
+        scheduler.submit(
+            std::move(input),
+            [respond](std::optional<Layer::Vec_t> output, std::exception_ptr error) {
+                respond(output ? protocol::Ok : deadlineMissed(error) ? protocol::DeadlineMissed : protocol::Failed, output ? &*output : nullptr);
+            },
+            deadline, request.priority);
+    }
+}
+
+} // namespace
+
+int main(int argc, char** argv)
+{
+    if (argc < 3) {
+        std::fprintf(stderr, "usage: %s <socket> <model file | random:2,16,16,2> [--max-rows N] [--max-delay-us T] [--workers W]\n", argv[0]);
+        return 1;
+    }
+
+    BatchScheduler::Options options;
+    for (int i = 3; i + 1 < argc; i += 2) {
+        std::string const option = argv[i];
+        Size_t const value = std::stoul(argv[i + 1]);
+        if (option == "--max-rows")
+            options.maxRows = value;
+        else if (option == "--max-delay-us")
+            options.maxDelay = std::chrono::microseconds(value);
+        else if (option == "--workers")
+            options.workers = value;
+        else {
+            std::fprintf(stderr, "unknown option %s\n", option.c_str());
+            return 1;
+        }
+    }
+
+    // the signals are taken by sigwait below, every thread inherits the mask
+    sigset_t signals;
+    sigemptyset(&signals);
+    sigaddset(&signals, SIGINT);
+    sigaddset(&signals, SIGTERM);
+    sigaddset(&signals, SIGHUP);
+    pthread_sigmask(SIG_BLOCK, &signals, nullptr);
+
+    std::string const path = argv[1];
+    BatchScheduler scheduler(DenseNN::loadModel(argv[2]), options);
+    LatencyLog log;
+    int const listener = protocol::listenUnix(path);
+    std::printf("serving %s, %zu inputs, batches of up to %zu rows or %lld us\n", path.c_str(), scheduler.inputSize(),
+                options.maxRows, static_cast<long long>(options.maxDelay.count()));
+    std::fflush(stdout);
+
+    std::thread([&] {
+        for (int fd; (fd = ::accept(listener, nullptr, nullptr)) >= 0;) {
+            auto connection = std::make_shared<Connection>();
+            connection->fd = fd;
+            std::thread(serve, std::move(connection), std::ref(scheduler), std::ref(log)).detach();
+        }
+    }).detach();
+
+    auto const start = Clock_t::now();
+    std::thread([&] {
+        for (auto last = start;;) {
+            std::this_thread::sleep_for(std::chrono::seconds(1));
+            auto const now = Clock_t::now();
+            log.report(std::chrono::duration<double>(now - last).count(), false);
+            last = now;
+        }
+    }).detach();
+
+    int signal;
+    while (!sigwait(&signals, &signal) && signal == SIGHUP) {
+        try {
+            scheduler.swapModel(DenseNN::loadModel(argv[2]));
+            std::printf("swapped in %s\n", argv[2]);
+        }
+        catch (std::exception const& e) {
+            std::printf("kept the model: %s\n", e.what());
+        }
+        std::fflush(stdout);
+    }
+    log.report(std::chrono::duration<double>(Clock_t::now() - start).count(), true);
+    auto const stats = scheduler.stats();
+    std::printf("%zu requests in %zu batches, %zu missed deadlines, %zu failed\n", stats.requests, stats.batches, stats.missedDeadlines, stats.failures);
+    std::fflush(stdout);
+    ::unlink(path.c_str());
+    // connections may still block in their reads, leave without unwinding them
+    std::_Exit(0);
+}
@@ -0,0 +1,137 @@
+#include <InferenceProtocol.hpp>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <string>
+#include <thread>
+
+#include <unistd.h>
+
+// Closed-loop load for inference-server: every connection keeps depth requests in flight.
+//   load-generator <socket> --inputs N [--connections C] [--requests R] [--depth D]
+//                  [--budget-us B] [--priorities P]
+// R requests are sent per connection, with a deadline budget of B us (0: none) and priorities
+// cycling through [0, P).
+
+namespace {
+
+using Clock_t = std::chrono::steady_clock;
+
+struct Options {
+    std::string path;
+    Size_t inputs = 0;
+    Size_t connections = 16;
+    Size_t requests = 10000;
+    Size_t depth = 4;
+    Size_t budgetMicros = 0;
+    Size_t priorities = 1;
+};
+
+struct Results {
+    std::vector<double> micros;
+    Size_t missed = 0;
+    Size_t failed = 0;
+};
+
+Results drive(Options const& options, Size_t seed)
+{
+    int const fd = protocol::connectUnix(options.path);
+    std::vector<Real_t> input(options.inputs);
+    std::vector<Clock_t::time_point> sent(options.requests);
+    Results results;
+    results.micros.reserve(options.requests);
+
+    Size_t next = 0, received = 0;
+    auto const send = [&] {
+        for (auto& value : input)
+            value = Real_t((seed * 7919 + next * 104729 + (&value - input.data())) % 1000) / 500 - 1;
+        protocol::RequestHeader request;
+        request.id = next;
+        request.size = input.size();
+        request.priority = (seed + next) % options.priorities;
+        request.budgetMicros = options.budgetMicros;
+        sent[next++] = Clock_t::now();
+        return protocol::writeRequest(fd, request, input.data());
+    };
+
+    protocol::ResponseHeader response;
+    std::vector<Real_t> output;
+    while (received < options.requests) {
+        while (next < options.requests && next - received < options.depth)
+            if (!send())
+                throw std::runtime_error("The server closed the connection");
+        if (!protocol::readResponse(fd, response, output) || response.id >= next)
+            throw std::runtime_error("The server closed the connection");
+        ++received;
+        if (response.status == protocol::Ok)
+            results.micros.push_back(std::chrono::duration<double, std::micro>(Clock_t::now() - sent[response.id]).count());
+        else
+            ++(response.status == protocol::DeadlineMissed ? results.missed : results.failed);
+    }
+    ::close(fd);
+    return results;
+}
+
+} // namespace
+
+int main(int argc, char** argv)
+{
+    Options options;
+    if (argc > 1)
+        options.path = argv[1];
+    for (int i = 2; i + 1 < argc; i += 2) {
+        std::string const option = argv[i];
+        Size_t const value = std::stoul(argv[i + 1]);
+        if (option == "--inputs")
+            options.inputs = value;
+        else if (option == "--connections")
+            options.connections = value;
+        else if (option == "--requests")
+            options.requests = value;
+        else if (option == "--depth")
+            options.depth = std::max<Size_t>(1, value);
+        else if (option == "--budget-us")
+            options.budgetMicros = value;
+        else if (option == "--priorities")
+            options.priorities = std::max<Size_t>(1, value);
+        else {
+            std::fprintf(stderr, "unknown option %s\n", option.c_str());
+            return 1;
+        }
+    }
+    if (options.path.empty() || !options.inputs) {
+        std::fprintf(stderr, "usage: %s <socket> --inputs N [--connections C] [--requests R] [--depth D] [--budget-us B] [--priorities P]\n", argv[0]);
+        return 1;
+    }
+
+    std::vector<Results> results(options.connections);
+    std::vector<std::thread> threads;
+    std::atomic<bool> failed{ false };
+    auto const start = Clock_t::now();
+    for (Size_t c = 0; c < options.connections; ++c)
+        threads.emplace_back([&, c] {
+            try {
+                results[c] = drive(options, c);
+            }
+            catch (std::exception const& e) {
+                std::fprintf(stderr, "connection %zu: %s\n", c, e.what());
+                failed = true;
+            }
+        });
+    for (auto& thread : threads)
+        thread.join();
+    double const seconds = std::chrono::duration<double>(Clock_t::now() - start).count();
+
+    Results total;
+    for (auto& r : results) {
+        total.micros.insert(total.micros.end(), r.micros.begin(), r.micros.end());
+        total.missed += r.missed;
+        total.failed += r.failed;
+    }
+    std::sort(total.micros.begin(), total.micros.end());
+    auto const percentile = [&](double p) { return total.micros.empty() ? 0 : total.micros[Size_t(p * (total.micros.size() - 1))]; };
+    std::printf("%zu answered in %.2f s: %.0f req/s  p50 %.1f us  p99 %.1f us  missed %zu  rejected %zu\n", total.micros.size(),
+                seconds, (total.micros.size() + total.missed) / seconds, percentile(0.5), percentile(0.99), total.missed, total.failed);
+    return failed;
+}
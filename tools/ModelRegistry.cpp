@@ -0,0 +1,46 @@
+#include <SharedModel.hpp>
+#include <cstdio>
+#include <string>
+
+// Publishes saved DenseNNs (or random ones, "random:2,16,16,2") to shared memory, where every
+// process on the machine can open them by name without a copy of the weights of its own:
+//   model-registry publish <name> <model>
+//   model-registry remove <name>
+//   model-registry info <name>
+
+namespace {
+
+int usage()
+{
+    std::fprintf(stderr, "usage: model-registry publish <name> <model|random:a,b,...>\n"
+                         "       model-registry remove <name>\n"
+                         "       model-registry info <name>\n");
+    return 2;
+}
+
+} // namespace
+
+int main(int argc, char** argv)
+{
+    if (argc < 3)
+        return usage();
+    std::string const command = argv[1];
+    std::string const name = argv[2];
+
+    try {
+        if (command == "publish" && argc == 4)
+            SharedModel::publish(name, DenseNN::loadModel(argv[3]));
+        else if (command == "remove" && argc == 3)
+            SharedModel::remove(name);
+        else if (command == "info" && argc == 3) {
+            SharedModel const model = SharedModel::open(name);
+            std::printf("%s: %zu layers, %zu inputs, %zu bytes shared\n", name.c_str(), model.layerCount(), model.inputSize(), model.bytes());
+        } else
+            return usage();
+    }
+    catch (std::exception const& e) {
+        std::fprintf(stderr, "%s\n", e.what());
+        return 1;
+    }
+    return 0;
+}